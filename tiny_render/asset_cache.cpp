@@ -0,0 +1,104 @@
+#include "asset_cache.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include <system_error>
+#include <unordered_map>
+
+namespace {
+std::filesystem::file_time_type ModificationTime(const std::string &path) {
+  std::error_code error;
+  const auto time = std::filesystem::last_write_time(path, error);
+  return error ? std::filesystem::file_time_type::min() : time;
+}
+
+size_t ModelBytes(const Model &model) {
+  return model.verts().size_bytes() + model.uvs().size_bytes() +
+         model.norms().size_bytes() + model.corners().size_bytes();
+}
+
+size_t MeshBytes(const CompactMesh &mesh) { return mesh.bytes(); }
+
+size_t TextureBytes(const TGAImage &image) {
+  return static_cast<size_t>(image.width()) * image.height() *
+         image.bytes_per_pixel();
+}
+} // namespace
+
+std::shared_ptr<const TGAImage> LoadSharedTexture(const std::string &path) {
+  struct Entry {
+    std::mutex mutex;
+    std::filesystem::file_time_type stamp;
+    std::weak_ptr<const TGAImage> texture;
+  };
+  static std::mutex mutex;
+  // Entries outlive their textures; there is one per distinct path.
+  static std::unordered_map<std::string, std::shared_ptr<Entry>> entries;
+  std::shared_ptr<Entry> entry;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::shared_ptr<Entry> &slot = entries[path];
+    if (!slot)
+      slot = std::make_shared<Entry>();
+    entry = slot;
+  }
+  const auto stamp = ModificationTime(path);
+  if (stamp == std::filesystem::file_time_type::min())
+    return nullptr;
+  // Concurrent loads of one path wait for the first instead of decoding it
+  // again; different paths load in parallel.
+  std::lock_guard<std::mutex> lock(entry->mutex);
+  std::shared_ptr<const TGAImage> texture = entry->texture.lock();
+  if (texture && entry->stamp == stamp)
+    return texture;
+  // Read into owned pixels rather than mapped: the texture outlives this
+  // call by far, and the file may be rewritten in place under it.
+  auto image = std::make_shared<TGAImage>();
+  if (!image->ReadTgaFile(path.c_str()))
+    return nullptr;
+  // Texel rows count up from v = 0, the order most files already use.
+  image->SetRowOrder(TGAImage::RowOrder::kBottomUp);
+  entry->stamp = stamp;
+  entry->texture = image;
+  return image;
+}
+
+AssetCache::AssetCache(size_t model_bytes, size_t texture_bytes,
+                       size_t mesh_bytes)
+    : models_(model_bytes, ModelBytes), textures_(texture_bytes, TextureBytes),
+      meshes_(mesh_bytes, MeshBytes) {}
+
+std::shared_ptr<const TGAImage>
+AssetCache::GetTexture(const std::string &path) {
+  return textures_.Get(path, ModificationTime(path),
+                       [&] { return LoadSharedTexture(path); });
+}
+
+std::shared_ptr<const Model> AssetCache::GetModel(const std::string &path) {
+  const std::string texture_path = Model::TexturePath(path, "_diffuse.tga");
+  // Editing either file must give a new model, and a file's time only moves
+  // forward, so the later of the two identifies the pair.
+  const auto stamp =
+      std::max(ModificationTime(path), ModificationTime(texture_path));
+  return models_.Get(path, stamp, [&]() -> std::shared_ptr<const Model> {
+    if (ModificationTime(path) == std::filesystem::file_time_type::min())
+      return nullptr;
+    // Jobs already run in parallel, so each model is parsed on one thread.
+    return std::make_shared<Model>(path.c_str(), GetTexture(texture_path), 1);
+  });
+}
+
+std::shared_ptr<const CompactMesh>
+AssetCache::GetCompactMesh(const std::string &path) {
+  const std::string texture_path = Model::TexturePath(path, "_diffuse.tga");
+  const auto stamp =
+      std::max(ModificationTime(path), ModificationTime(texture_path));
+  return meshes_.Get(path, stamp, [&]() -> std::shared_ptr<const CompactMesh> {
+    if (ModificationTime(path) == std::filesystem::file_time_type::min())
+      return nullptr;
+    const Model model(path.c_str(), GetTexture(texture_path), 1,
+                      ModelLoadFlags::kUvs);
+    return std::make_shared<CompactMesh>(model);
+  });
+}
@@ -0,0 +1,46 @@
+#ifndef GRAPHICS_TINY_READER_ASSET_CACHE_H_
+#define GRAPHICS_TINY_READER_ASSET_CACHE_H_
+
+#include <memory>
+#include <string>
+
+#include "compact_mesh.h"
+#include "lru_cache.h"
+#include "model.h"
+#include "tga_image.h"
+
+// The texture at path, with rows bottom-up as Model samples them. While any
+// holder keeps it alive, loading the same unchanged file returns it instead
+// of decoding it again. nullptr if it cannot be read.
+std::shared_ptr<const TGAImage> LoadSharedTexture(const std::string &path);
+
+// Models, compact meshes and decoded textures shared between renders, keyed
+// by path and modification time. Each kind has its own size budget; a model
+// or mesh holds on to its texture, so an evicted texture stays alive while a
+// cached one still uses it.
+class AssetCache {
+public:
+  explicit AssetCache(size_t model_bytes = size_t{256} << 20,
+                      size_t texture_bytes = size_t{256} << 20,
+                      size_t mesh_bytes = size_t{256} << 20);
+
+  // LoadSharedTexture(path), kept alive while it fits the budget.
+  std::shared_ptr<const TGAImage> GetTexture(const std::string &path);
+  // The model at path with its diffuse texture taken from GetTexture. The
+  // model is reloaded when either file changes. nullptr if it cannot be read.
+  std::shared_ptr<const Model> GetModel(const std::string &path);
+  // The model at path as a CompactMesh. The full Model is only kept while
+  // the mesh is built, so a mesh costs about a third of a cached model.
+  std::shared_ptr<const CompactMesh> GetCompactMesh(const std::string &path);
+
+  CacheStats model_stats() const { return models_.stats(); }
+  CacheStats texture_stats() const { return textures_.stats(); }
+  CacheStats mesh_stats() const { return meshes_.stats(); }
+
+private:
+  LruCache<Model> models_;
+  LruCache<TGAImage> textures_;
+  LruCache<CompactMesh> meshes_;
+};
+
+#endif // GRAPHICS_TINY_READER_ASSET_CACHE_H_
@@ -0,0 +1,85 @@
+#include "batch_renderer.h"
+
+#include <chrono>
+#include <sstream>
+
+#include "compact_mesh.h"
+#include "rasterizer.h"
+#include "tiled_renderer.h"
+
+bool ParseRenderJob(const std::string &line, RenderJob &job) {
+  std::istringstream in(line);
+  std::string model;
+  if (!(in >> model) || model[0] == '#')
+    return false;
+  RenderJob parsed;
+  parsed.model = model;
+  in >> parsed.width >> parsed.height >> parsed.eye.x >> parsed.eye.y >>
+      parsed.eye.z >> parsed.light_dir.x >> parsed.light_dir.y >>
+      parsed.light_dir.z >> parsed.output;
+  if (in.fail() || parsed.width <= 0 || parsed.height <= 0)
+    return false;
+  std::string flag;
+  if (in >> flag) {
+    if (flag != "compact")
+      return false;
+    parsed.compact = true;
+  }
+  parsed.light_dir.Normalize();
+  job = std::move(parsed);
+  return true;
+}
+
+bool Render(const RenderJob &job, AssetCache &cache, FramebufferPool &pool,
+            TaskScheduler &scheduler) {
+  std::shared_ptr<const Model> model;
+  std::shared_ptr<const CompactMesh> mesh;
+  if (job.compact)
+    mesh = cache.GetCompactMesh(job.model);
+  else
+    model = cache.GetModel(job.model);
+  if (!model && !mesh)
+    return false;
+  const Matrix transform =
+      PerspectiveTransform(job.width, job.height, job.eye, Vec3f(0, 0, 0));
+  DepthBuffer depth(job.width, job.height);
+  TGAImage image = pool.Acquire(job.width, job.height, TGAImage::RGB);
+  if (mesh)
+    DrawCompactMesh(*mesh, transform, job.light_dir, depth, image);
+  else
+    DrawModel(scheduler, *model, transform, job.light_dir, depth, image);
+  image.DeclareRowOrder(TGAImage::RowOrder::kBottomUp);
+  const bool ok = image.WriteTgaFile(job.output.c_str());
+  pool.Release(std::move(image));
+  return ok;
+}
+
+BatchRenderer::BatchRenderer(AssetCache &cache, TaskScheduler &scheduler,
+                             std::ostream &log)
+    : cache_(cache), scheduler_(scheduler), log_(log) {}
+
+BatchRenderer::~BatchRenderer() { Finish(); }
+
+void BatchRenderer::Submit(RenderJob job) {
+  // Two jobs per thread keep every thread busy without reading the whole
+  // manifest ahead.
+  scheduler_.Wait(jobs_, static_cast<size_t>(scheduler_.threads()) * 2);
+  scheduler_.Spawn(jobs_, [this, job = std::move(job)] { Work(job); });
+}
+
+size_t BatchRenderer::Finish() {
+  scheduler_.Wait(jobs_);
+  return failed_;
+}
+
+void BatchRenderer::Work(const RenderJob &job) {
+  const auto start = std::chrono::steady_clock::now();
+  const bool ok = Render(job, cache_, pool_, scheduler_);
+  const double ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  failed_ += !ok;
+  std::lock_guard<std::mutex> lock(log_mutex_);
+  log_ << (ok ? "Rendered " : "Failed ") << job.output << " from "
+       << job.model << " in " << ms << " ms" << std::endl;
+}
@@ -0,0 +1,63 @@
+#ifndef GRAPHICS_TINY_READER_BATCH_RENDERER_H_
+#define GRAPHICS_TINY_READER_BATCH_RENDERER_H_
+
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+#include "asset_cache.h"
+#include "framebuffer_pool.h"
+#include "geometry.h"
+#include "task_scheduler.h"
+
+// One frame of the main_4 scene with its own model, camera, light and size.
+struct RenderJob {
+  std::string model;
+  int width = 800;
+  int height = 800;
+  Vec3f eye = Vec3f(0, 0, 3);
+  Vec3f light_dir = Vec3f(0, 0, -1);
+  std::string output;
+  // Draws the model's CompactMesh instead of the Model.
+  bool compact = false;
+};
+
+// Parses one manifest line of whitespace separated fields:
+//   model width height eye_x eye_y eye_z light_x light_y light_z output
+//   [compact]
+// Returns false for blank lines, '#' comments and malformed lines.
+bool ParseRenderJob(const std::string &line, RenderJob &job);
+
+// Renders one job, taking the model from cache and the frame from pool; a
+// Model's faces are drawn by the tiled renderer on scheduler.
+bool Render(const RenderJob &job, AssetCache &cache, FramebufferPool &pool,
+            TaskScheduler &scheduler);
+
+// Runs each job as a task on scheduler, sharing one asset cache and one
+// framebuffer pool, and logs one line per finished job to log.
+class BatchRenderer {
+public:
+  BatchRenderer(AssetCache &cache, TaskScheduler &scheduler,
+                std::ostream &log);
+  ~BatchRenderer();
+
+  // Runs queued tasks on the calling thread while the scheduler is too far
+  // behind, then queues job.
+  void Submit(RenderJob job);
+  // Waits for every submitted job. Returns the number of jobs that failed.
+  size_t Finish();
+
+private:
+  void Work(const RenderJob &job);
+
+  AssetCache &cache_;
+  TaskScheduler &scheduler_;
+  FramebufferPool pool_;
+  TaskGroup jobs_;
+  std::atomic<size_t> failed_ = 0;
+  std::mutex log_mutex_;
+  std::ostream &log_;
+};
+
+#endif // GRAPHICS_TINY_READER_BATCH_RENDERER_H_
@@ -0,0 +1,75 @@
+#ifndef GRAPHICS_TINY_READER_BOUNDED_QUEUE_H_
+#define GRAPHICS_TINY_READER_BOUNDED_QUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Blocking single-lock FIFO with a fixed capacity, used to hand work between
+// pipeline threads without letting a fast producer run ahead unbounded.
+template <typename T> class BoundedQueue {
+public:
+  explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+  // Blocks while the queue is full. Returns false if the queue was closed.
+  bool Push(T &&item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_full_.wait(lock, [&] { return closed_ || items_.size() < capacity_; });
+    if (closed_)
+      return false;
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Returns false instead of blocking when the queue is full or closed.
+  bool TryPush(T &&item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (closed_ || items_.size() >= capacity_)
+      return false;
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Blocks while the queue is empty. Returns false once it is closed and
+  // drained.
+  bool Pop(T &item) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    not_empty_.wait(lock, [&] { return closed_ || !items_.empty(); });
+    if (items_.empty())
+      return false;
+    item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  bool TryPop(T &item) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (items_.empty())
+      return false;
+    item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return true;
+  }
+
+  // Wakes every waiter; later pushes fail and pops drain what is left.
+  void Close() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    closed_ = true;
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+private:
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  std::deque<T> items_;
+  size_t capacity_;
+  bool closed_ = false;
+};
+
+#endif // GRAPHICS_TINY_READER_BOUNDED_QUEUE_H_
@@ -0,0 +1,25 @@
+#ifndef GRAPHICS_TINY_READER_CARVE_H_
+#define GRAPHICS_TINY_READER_CARVE_H_
+
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <type_traits>
+
+// Takes the next n elements of type T from the block at p and advances p.
+// Blocks come from new[], aligned for any element type, so carving arrays in
+// order of decreasing alignment keeps each one aligned without padding;
+// debug builds check that p is.
+template <typename T> std::span<T> Carve(unsigned char *&p, size_t n) {
+  static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+  static_assert(std::is_trivially_destructible_v<T>,
+                "carved elements are freed with their block, not destroyed");
+  assert(reinterpret_cast<std::uintptr_t>(p) % alignof(T) == 0);
+  T *first = reinterpret_cast<T *>(p);
+  std::uninitialized_default_construct_n(first, n);
+  p += n * sizeof(T);
+  return std::span<T>(first, n);
+}
+
+#endif // GRAPHICS_TINY_READER_CARVE_H_
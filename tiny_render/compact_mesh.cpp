@@ -0,0 +1,137 @@
+#include "compact_mesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "carve.h"
+#include "profiler.h"
+#include "rasterizer.h"
+
+namespace {
+constexpr float kMaxStep = 65535.f;
+
+// Marks a corner without a uv; never a valid index.
+constexpr uint32_t kNoIndex32 = 0xffffffff;
+constexpr uint16_t kNoIndex16 = 0xffff;
+
+uint16_t Quantize(float value, float lo, float step) {
+  if (!(step > 0.f))
+    return 0;
+  return static_cast<uint16_t>(
+      std::clamp(std::round((value - lo) / step), 0.f, kMaxStep));
+}
+
+uint16_t Unorm16(float value) {
+  return static_cast<uint16_t>(std::round(std::clamp(value, 0.f, 1.f) *
+                                          kMaxStep));
+}
+} // namespace
+
+CompactMesh::CompactMesh(const Model &model)
+    : nverts_(model.nverts()), nfaces_(model.nfaces()),
+      origin_(model.bbox_min()), diffuse_map_(model.shared_diffuse_map()) {
+  const Vec3f extent = model.bbox_max() - model.bbox_min();
+  step_ = extent * (1.f / kMaxStep);
+  const size_t nuvs = model.uvs().size();
+  const size_t ncorners = nfaces_ * 3;
+  const bool wide = std::max(nverts_, nuvs) >= kNoIndex16;
+  bytes_ = ncorners * 2 * (wide ? sizeof(uint32_t) : sizeof(uint16_t)) +
+           (nverts_ * 3 + nuvs * 2) * sizeof(uint16_t);
+  storage_ = std::make_unique_for_overwrite<unsigned char[]>(bytes_);
+  // Wider types are carved first, so each one stays aligned.
+  unsigned char *p = storage_.get();
+  if (wide)
+    indices32_ = Carve<uint32_t>(p, ncorners * 2);
+  else
+    indices16_ = Carve<uint16_t>(p, ncorners * 2);
+  positions_ = Carve<uint16_t>(p, nverts_ * 3);
+  uvs_ = Carve<uint16_t>(p, nuvs * 2);
+
+  for (size_t v = 0; v < nverts_; v++) {
+    const Vec3f vert = model.vert(v);
+    for (int i = 0; i < 3; i++)
+      positions_[v * 3 + i] = Quantize(vert[i], origin_[i], step_[i]);
+  }
+  for (size_t t = 0; t < nuvs; t++) {
+    uvs_[t * 2] = Unorm16(model.uvs()[t].x);
+    uvs_[t * 2 + 1] = Unorm16(model.uvs()[t].y);
+  }
+  const std::span<const Vec3i> corners = model.corners();
+  for (size_t c = 0; c < ncorners; c++) {
+    const int uv = corners[c].iuv;
+    const bool has_uv = uv >= 0 && static_cast<size_t>(uv) < nuvs;
+    if (wide) {
+      indices32_[c * 2] = corners[c].ivert;
+      indices32_[c * 2 + 1] = has_uv ? uv : kNoIndex32;
+    } else {
+      indices16_[c * 2] = corners[c].ivert;
+      indices16_[c * 2 + 1] = has_uv ? uv : kNoIndex16;
+    }
+  }
+}
+
+std::array<size_t, 3> CompactMesh::face(size_t idx) const {
+  return {index(idx * 6), index(idx * 6 + 2), index(idx * 6 + 4)};
+}
+
+Vec3f CompactMesh::vert(size_t i) const {
+  return Vec3f(origin_.x + positions_[i * 3] * step_.x,
+               origin_.y + positions_[i * 3 + 1] * step_.y,
+               origin_.z + positions_[i * 3 + 2] * step_.z);
+}
+
+Vec2i CompactMesh::uv(size_t face_id, size_t vertex_id) const {
+  const size_t idx = index((face_id * 3 + vertex_id) * 2 + 1);
+  if (idx == (wide_indices() ? kNoIndex32 : kNoIndex16))
+    return Vec2i(0, 0);
+  const TGAImage &texture = diffuse_map();
+  return Vec2i(uvs_[idx * 2] / kMaxStep * texture.width(),
+               uvs_[idx * 2 + 1] / kMaxStep * texture.height());
+}
+
+Matrix CompactMesh::Dequantize() const {
+  Matrix m = Matrix::Identity(4);
+  for (int i = 0; i < 3; i++) {
+    m[i][i] = step_[i];
+    m[i][3] = origin_[i];
+  }
+  return m;
+}
+
+void DrawCompactMesh(const CompactMesh &mesh, const Matrix &transform,
+                     const Vec3f &light_dir, DepthBuffer &depth,
+                     TGAImage &image) {
+  const Matrix dequantized = transform * mesh.Dequantize();
+  const std::span<const uint16_t> q = mesh.positions();
+  std::vector<Vec3f> screen(mesh.nverts());
+  {
+    PROFILE_SCOPE(kTransform);
+    for (size_t v = 0; v < mesh.nverts(); v++) {
+      screen[v] = dequantized.TransformPoint(
+          Vec3f(q[v * 3], q[v * 3 + 1], q[v * 3 + 2]));
+    }
+  }
+  const Vec3f step = mesh.step();
+  // Edge from vertex a to b in object space; the origin cancels out.
+  const auto edge = [&](size_t a, size_t b) {
+    return Vec3f((q[b * 3] - q[a * 3]) * step.x,
+                 (q[b * 3 + 1] - q[a * 3 + 1]) * step.y,
+                 (q[b * 3 + 2] - q[a * 3 + 2]) * step.z);
+  };
+  PROFILE_SCOPE(kRaster);
+  for (size_t i = 0; i < mesh.nfaces(); i++) {
+    PROFILE_COUNT(kTrianglesSubmitted, 1);
+    const std::array<size_t, 3> f = mesh.face(i);
+    Vec3f n = edge(f[0], f[2]) ^ edge(f[0], f[1]);
+    n.Normalize();
+    const float intensity = n * light_dir;
+    if (!(intensity > 0)) {
+      PROFILE_COUNT(kTrianglesCulled, 1);
+      continue;
+    }
+    DrawTriangle(screen[f[0]], screen[f[1]], screen[f[2]], mesh.uv(i, 0),
+                 mesh.uv(i, 1), mesh.uv(i, 2), mesh.diffuse_map(), intensity,
+                 depth, image);
+  }
+}
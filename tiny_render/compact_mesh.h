@@ -0,0 +1,70 @@
+#ifndef GRAPHICS_TINY_READER_COMPACT_MESH_H_
+#define GRAPHICS_TINY_READER_COMPACT_MESH_H_
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "tga_image.h"
+
+// The drawable part of a Model in about a third of the memory: positions as
+// three 16-bit steps across the model's bounding box, uvs as 16-bit unorm
+// pairs (clamped to [0, 1]) and corners as a vertex and a uv index, 16-bit
+// when both counts fit and 32-bit otherwise. Normals are not kept, since the
+// forward pipeline lights faces by their geometric normal. Like Model, the
+// arrays live in one block.
+class CompactMesh {
+public:
+  explicit CompactMesh(const Model &model);
+
+  size_t nverts() const { return nverts_; }
+  size_t nfaces() const { return nfaces_; }
+  bool wide_indices() const { return !indices32_.empty(); }
+  // Size of the block holding the arrays.
+  size_t bytes() const { return bytes_; }
+
+  std::array<size_t, 3> face(size_t idx) const;
+  // Dequantized position of vertex i.
+  Vec3f vert(size_t i) const;
+  Vec2i uv(size_t face_id, size_t vertex_id) const;
+  // Maps quantized positions, as floats, back to object space; composed into
+  // the vertex transform so that dequantizing costs nothing per vertex.
+  Matrix Dequantize() const;
+  // Object-space size of one quantization step along each axis.
+  Vec3f step() const { return step_; }
+  std::span<const uint16_t> positions() const { return positions_; }
+
+  const TGAImage &diffuse_map() const { return *diffuse_map_; }
+
+private:
+  // Entry i of the index array, which holds corner c's vertex index at 2c
+  // and its uv index at 2c + 1.
+  size_t index(size_t i) const {
+    return indices16_.empty() ? indices32_[i] : indices16_[i];
+  }
+
+  size_t nverts_;
+  size_t nfaces_;
+  Vec3f origin_;
+  Vec3f step_;
+  std::unique_ptr<unsigned char[]> storage_;
+  size_t bytes_ = 0;
+  std::span<uint32_t> indices32_;
+  std::span<uint16_t> indices16_;
+  std::span<uint16_t> positions_;
+  std::span<uint16_t> uvs_;
+  std::shared_ptr<const TGAImage> diffuse_map_;
+};
+
+// Draws the mesh as DrawFace draws a Model's faces. The quantized positions
+// go through transform * mesh.Dequantize() once per vertex, and faces are lit
+// by normals rebuilt from the integer position differences.
+void DrawCompactMesh(const CompactMesh &mesh, const Matrix &transform,
+                     const Vec3f &light_dir, DepthBuffer &depth,
+                     TGAImage &image);
+
+#endif // GRAPHICS_TINY_READER_COMPACT_MESH_H_
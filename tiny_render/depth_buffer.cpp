@@ -0,0 +1,86 @@
+#include "depth_buffer.h"
+
+namespace {
+struct FormatName {
+  DepthFormat format;
+  const char *name;
+};
+
+constexpr FormatName kFormatNames[] = {
+    {DepthFormat::kFloat32, "float"},
+    {DepthFormat::kUnorm16, "unorm16"},
+    {DepthFormat::kUnorm24, "unorm24"},
+    {DepthFormat::kFloat32ReversedZ, "reversed"},
+};
+} // namespace
+
+bool ParseDepthFormat(const std::string &name, DepthFormat &format) {
+  for (const FormatName &entry : kFormatNames) {
+    if (name == entry.name) {
+      format = entry.format;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *DepthFormatName(DepthFormat format) {
+  for (const FormatName &entry : kFormatNames) {
+    if (entry.format == format)
+      return entry.name;
+  }
+  return "unknown";
+}
+
+DepthBuffer::DepthBuffer(int width, int height, DepthFormat format)
+    : width_(width), height_(height), format_(format) {
+  const size_t bytes =
+      static_cast<size_t>(width) * height * bytes_per_pixel();
+  storage_.resize((bytes + 3) / 4);
+  Clear();
+}
+
+int DepthBuffer::bytes_per_pixel() const {
+  return VisitDepthFormat(format_,
+                          [](auto format) { return decltype(format)::kBytes; });
+}
+
+void DepthBuffer::Clear() {
+  VisitDepthFormat(format_, [&](auto format) {
+    using Format = decltype(format);
+    if (Format::kClear == 0) {
+      std::fill(storage_.begin(), storage_.end(), 0u);
+      return;
+    }
+    const size_t n = static_cast<size_t>(width_) * height_;
+    for (size_t i = 0; i < n; i++)
+      Format::Store(data(), i, Format::kClear);
+  });
+}
+
+void DepthBuffer::Clear(int x0, int y0, int x1, int y1) {
+  VisitDepthFormat(format_, [&](auto format) {
+    using Format = decltype(format);
+    for (int y = y0; y < y1; y++) {
+      const size_t row = static_cast<size_t>(y) * width_;
+      for (int x = x0; x < x1; x++)
+        Format::Store(data(), row + x, Format::kClear);
+    }
+  });
+}
+
+float DepthBuffer::Get(int x, int y) const {
+  return VisitDepthFormat(format_, [&](auto format) {
+    using Format = decltype(format);
+    return Format::Decode(
+        Format::Load(data(), x + static_cast<size_t>(y) * width_));
+  });
+}
+
+void DepthBuffer::Set(int x, int y, float z) {
+  VisitDepthFormat(format_, [&](auto format) {
+    using Format = decltype(format);
+    Format::Store(data(), x + static_cast<size_t>(y) * width_,
+                  Format::Encode(z));
+  });
+}
@@ -0,0 +1,169 @@
+#ifndef GRAPHICS_TINY_READER_DEPTH_BUFFER_H_
+#define GRAPHICS_TINY_READER_DEPTH_BUFFER_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Depth range of the viewport: screen-space z is kDepth * near / view depth
+// (see PerspectiveTransform), so it runs from kDepth on the near plane down
+// to 0 at infinity. Larger z is nearer throughout the renderer.
+constexpr int kDepth = 255;
+
+enum class DepthFormat {
+  // Screen z as is, unbounded, so points nearer than the near plane still
+  // resolve; what the renderer has always used. It is kFloat32ReversedZ
+  // scaled by kDepth, with the same precision.
+  kFloat32,
+  // z / kDepth, which is near / view depth, clamped to [0, 1] in 16 or 24
+  // bits (three packed bytes). Only points nearer than the near plane clamp.
+  // The codes are spread evenly in 1 / distance, so precision falls off with
+  // the square of the distance.
+  kUnorm16,
+  kUnorm24,
+  // near / view depth in a float, cleared to 0: 1 on the near plane and 0 at
+  // infinity (reversed Z with an infinite far plane). The float's exponent
+  // gives finer steps towards 0, which offsets the coarser steps of
+  // 1 / distance far away.
+  kFloat32ReversedZ,
+};
+
+// Element i of an array of T in the depth storage. memcpy rather than a
+// pointer cast, which would alias the storage words; it compiles to the
+// same single load or store.
+template <typename T> T LoadValue(const unsigned char *data, size_t i) {
+  T v;
+  std::memcpy(&v, data + i * sizeof(T), sizeof(T));
+  return v;
+}
+template <typename T> void StoreValue(unsigned char *data, size_t i, T v) {
+  std::memcpy(data + i * sizeof(T), &v, sizeof(T));
+}
+
+// Storage and test of one format. Encode maps screen z to a stored Value
+// that orders the same way, so a fragment passes when its encoded depth is
+// greater than the stored one; Decode maps back to screen z.
+struct DepthFloat32 {
+  using Value = float;
+  static constexpr int kBytes = 4;
+  static constexpr Value kClear = -std::numeric_limits<float>::max();
+  static Value Encode(float z) { return z; }
+  static float Decode(Value v) { return v; }
+  static Value Load(const unsigned char *data, size_t i) {
+    return LoadValue<Value>(data, i);
+  }
+  static void Store(unsigned char *data, size_t i, Value v) {
+    StoreValue(data, i, v);
+  }
+};
+
+struct DepthUnorm16 {
+  using Value = uint16_t;
+  static constexpr int kBytes = 2;
+  static constexpr Value kClear = 0;
+  static Value Encode(float z) {
+    return z > 0.f ? std::min(z / kDepth, 1.f) * 65535.f + 0.5f : 0;
+  }
+  static float Decode(Value v) { return v * (kDepth / 65535.f); }
+  static Value Load(const unsigned char *data, size_t i) {
+    return LoadValue<Value>(data, i);
+  }
+  static void Store(unsigned char *data, size_t i, Value v) {
+    StoreValue(data, i, v);
+  }
+};
+
+struct DepthUnorm24 {
+  using Value = uint32_t;
+  static constexpr int kBytes = 3;
+  static constexpr Value kClear = 0;
+  static Value Encode(float z) {
+    return z > 0.f ? std::min(z / kDepth, 1.f) * 16777215.f + 0.5f : 0;
+  }
+  static float Decode(Value v) { return v * (kDepth / 16777215.f); }
+  static Value Load(const unsigned char *data, size_t i) {
+    const unsigned char *p = data + i * 3;
+    return p[0] | p[1] << 8 | p[2] << 16;
+  }
+  static void Store(unsigned char *data, size_t i, Value v) {
+    unsigned char *p = data + i * 3;
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = v >> 16;
+  }
+};
+
+struct DepthFloat32ReversedZ {
+  using Value = float;
+  static constexpr int kBytes = 4;
+  static constexpr Value kClear = 0.f;
+  static Value Encode(float z) { return z * (1.f / kDepth); }
+  static float Decode(Value v) { return v * kDepth; }
+  static Value Load(const unsigned char *data, size_t i) {
+    return LoadValue<Value>(data, i);
+  }
+  static void Store(unsigned char *data, size_t i, Value v) {
+    StoreValue(data, i, v);
+  }
+};
+
+// Calls fn with the policy struct of format, so a loop can be compiled once
+// per format and dispatched on outside it.
+template <typename Fn>
+decltype(auto) VisitDepthFormat(DepthFormat format, Fn fn) {
+  switch (format) {
+  case DepthFormat::kUnorm16:
+    return fn(DepthUnorm16());
+  case DepthFormat::kUnorm24:
+    return fn(DepthUnorm24());
+  case DepthFormat::kFloat32ReversedZ:
+    return fn(DepthFloat32ReversedZ());
+  case DepthFormat::kFloat32:
+  default:
+    return fn(DepthFloat32());
+  }
+}
+
+// "float", "unorm16", "unorm24" or "reversed".
+bool ParseDepthFormat(const std::string &name, DepthFormat &format);
+const char *DepthFormatName(DepthFormat format);
+
+// A z-buffer in one of the formats above.
+class DepthBuffer {
+public:
+  DepthBuffer(int width, int height,
+              DepthFormat format = DepthFormat::kFloat32);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  DepthFormat format() const { return format_; }
+  int bytes_per_pixel() const;
+
+  void Clear();
+  // Clears the pixels in [x0, x1) x [y0, y1).
+  void Clear(int x0, int y0, int x1, int y1);
+
+  // Screen z at a pixel, as stored; nothing drawn reads as the cleared value
+  // (-max for kFloat32, 0 otherwise).
+  float Get(int x, int y) const;
+  void Set(int x, int y, float z);
+
+  unsigned char *data() {
+    return reinterpret_cast<unsigned char *>(storage_.data());
+  }
+  const unsigned char *data() const {
+    return reinterpret_cast<const unsigned char *>(storage_.data());
+  }
+
+private:
+  int width_;
+  int height_;
+  DepthFormat format_;
+  // Words rather than bytes so float and 16-bit depths are aligned.
+  std::vector<uint32_t> storage_;
+};
+
+#endif // GRAPHICS_TINY_READER_DEPTH_BUFFER_H_
@@ -0,0 +1,101 @@
+#include "face_bins.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+TileGrid::TileGrid(int width, int height, int tile_size)
+    : width(width), height(height), tile_size(tile_size),
+      tiles_x((width + tile_size - 1) / tile_size),
+      tiles_y((height + tile_size - 1) / tile_size) {}
+
+TileRect TileGrid::Clip(int tile) const {
+  const int tx = tile % tiles_x;
+  const int ty = tile / tiles_x;
+  return TileRect{tx * tile_size, ty * tile_size,
+                  std::min((tx + 1) * tile_size, width),
+                  std::min((ty + 1) * tile_size, height)};
+}
+
+void FaceBins::Bin(const Model &model, size_t first, size_t last,
+                   const Matrix &transform, const Vec3f &light_dir,
+                   const TileGrid &grid) {
+  const int ntiles = grid.ntiles();
+  faces_.clear();
+  if (bins_.size() < static_cast<size_t>(ntiles))
+    bins_.resize(ntiles);
+  for (int t = 0; t < ntiles; t++)
+    bins_[t].clear();
+  for (size_t i = first; i < last; i++) {
+    const std::array<size_t, 3> face = model.face(i);
+    Vec3f world_coords[3];
+    ScreenFace screen;
+    for (int j = 0; j < 3; j++) {
+      world_coords[j] = model.vert(face[j]);
+      screen.uv[j] = model.uv(i, j);
+    }
+    if (!TransformFace(transform, light_dir, world_coords, screen.pts,
+                       screen.intensity))
+      continue;
+    TileRect tiles;
+    if (!TriangleTiles(screen.pts[0], screen.pts[1], screen.pts[2],
+                       grid.tile_size, grid.tiles_x, grid.tiles_y, tiles))
+      continue;
+    const uint32_t index = static_cast<uint32_t>(faces_.size());
+    faces_.push_back(screen);
+    for (int ty = tiles.y0; ty < tiles.y1; ty++) {
+      for (int tx = tiles.x0; tx < tiles.x1; tx++)
+        bins_[tx + ty * grid.tiles_x].push_back(index);
+    }
+  }
+}
+
+void FaceBins::Draw(int tile, const TGAImage &texture, const TileRect &clip,
+                    DepthBuffer &depth, TGAImage &image) const {
+  for (uint32_t index : bins_[tile]) {
+    const ScreenFace &f = faces_[index];
+    DrawTriangle(f.pts[0], f.pts[1], f.pts[2], f.uv[0], f.uv[1], f.uv[2],
+                 texture, f.intensity, clip, depth, image);
+  }
+}
+
+bool FaceRangeTiles(const Model &model, size_t first, size_t last,
+                    const Matrix &transform, const TileGrid &grid,
+                    TileRect &tiles) {
+  if (first >= last)
+    return false;
+  Vec3f lo(std::numeric_limits<float>::max(),
+           std::numeric_limits<float>::max(),
+           std::numeric_limits<float>::max());
+  Vec3f hi = lo * -1.f;
+  for (size_t i = first; i < last; i++) {
+    for (size_t v : model.face(i)) {
+      const Vec3f p = model.vert(v);
+      for (int k = 0; k < 3; k++) {
+        lo[k] = std::min(lo[k], p[k]);
+        hi[k] = std::max(hi[k], p[k]);
+      }
+    }
+  }
+  // With every corner in front of the camera the projected box holds the
+  // projection of every vertex inside it.
+  Vec3f screen_lo = lo, screen_hi = hi;
+  for (int corner = 0; corner < 8; corner++) {
+    const Vec3f p(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y,
+                  corner & 4 ? hi.z : lo.z);
+    float w;
+    const Vec3f s = transform.TransformPoint(p, &w);
+    if (w <= 0.f) {
+      tiles = TileRect{0, 0, grid.tiles_x, grid.tiles_y};
+      return tiles.x0 < tiles.x1 && tiles.y0 < tiles.y1;
+    }
+    for (int k = 0; k < 2; k++) {
+      screen_lo[k] = corner ? std::min(screen_lo[k], s[k]) : s[k];
+      screen_hi[k] = corner ? std::max(screen_hi[k], s[k]) : s[k];
+    }
+  }
+  // The box's corners bound every face's vertices, so the tiles of the
+  // triangle spanning them bound every face's tiles.
+  return TriangleTiles(screen_lo, screen_hi, screen_lo, grid.tile_size,
+                       grid.tiles_x, grid.tiles_y, tiles);
+}
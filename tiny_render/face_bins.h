@@ -0,0 +1,63 @@
+#ifndef GRAPHICS_TINY_READER_FACE_BINS_H_
+#define GRAPHICS_TINY_READER_FACE_BINS_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "rasterizer.h"
+#include "tga_image.h"
+
+// The screen tiles of a renderer that draws tile by tile: a grid of
+// tile_size square tiles over a width x height image, numbered row by row.
+struct TileGrid {
+  TileGrid(int width, int height, int tile_size);
+
+  int ntiles() const { return tiles_x * tiles_y; }
+  // The pixels of tile number tile.
+  TileRect Clip(int tile) const;
+
+  int width;
+  int height;
+  int tile_size;
+  int tiles_x;
+  int tiles_y;
+};
+
+// A run of a model's faces transformed, culled and binned into the tiles of
+// a grid, as the tiled renderers share them: the visible faces in model
+// order, and per tile the ones that may touch it. Storage is kept from one
+// Bin to the next.
+class FaceBins {
+public:
+  // Bins faces [first, last) of model, replacing what was binned before.
+  void Bin(const Model &model, size_t first, size_t last,
+           const Matrix &transform, const Vec3f &light_dir,
+           const TileGrid &grid);
+
+  bool empty(int tile) const { return bins_[tile].empty(); }
+  // Draws the faces binned for tile, in order, clipped to clip.
+  void Draw(int tile, const TGAImage &texture, const TileRect &clip,
+            DepthBuffer &depth, TGAImage &image) const;
+
+private:
+  struct ScreenFace {
+    Vec3f pts[3];
+    Vec2i uv[3];
+    float intensity;
+  };
+
+  std::vector<ScreenFace> faces_;
+  std::vector<std::vector<uint32_t>> bins_;
+};
+
+// The tiles that faces [first, last) of model may touch once carried to
+// screen by transform, from the bounding box of their vertices: every tile
+// if the box reaches behind the camera. Returns false if they touch none.
+bool FaceRangeTiles(const Model &model, size_t first, size_t last,
+                    const Matrix &transform, const TileGrid &grid,
+                    TileRect &tiles);
+
+#endif // GRAPHICS_TINY_READER_FACE_BINS_H_
@@ -0,0 +1,260 @@
+#include "frame_sink.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include <thread>
+#include <utility>
+
+struct SharedMemoryRingSlot;
+
+// Lives at the start of the segment, followed by the slots. Counters only
+// grow: the producer owns written and the reader owns released, so each
+// side stores its own and loads the other's.
+struct alignas(64) SharedMemoryRingHeader {
+  std::atomic<uint32_t> magic;
+  uint32_t width;
+  uint32_t height;
+  uint32_t bytes_per_pixel;
+  uint32_t slots;
+  uint64_t slot_bytes;
+  std::atomic<uint64_t> written;
+  std::atomic<uint64_t> released;
+  std::atomic<uint32_t> ended;
+
+  SharedMemoryRingSlot *slot(uint64_t frame) {
+    return reinterpret_cast<SharedMemoryRingSlot *>(
+        reinterpret_cast<unsigned char *>(this) + sizeof(*this) +
+        (frame % slots) * slot_bytes);
+  }
+};
+
+// Starts each slot, followed by the frame's pixels.
+struct alignas(64) SharedMemoryRingSlot {
+  // The index the frame was passed to Write with.
+  int64_t index;
+
+  unsigned char *pixels() {
+    return reinterpret_cast<unsigned char *>(this) + sizeof(*this);
+  }
+};
+
+namespace {
+constexpr uint32_t kRingMagic = 0x474e4952; // "RING"
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "ring counters must work across processes");
+
+// The other side of the ring runs in another process, so waits poll.
+void Pause() { std::this_thread::sleep_for(std::chrono::microseconds(100)); }
+
+// Writes every byte of iov[0, count), resuming after short writes.
+bool WriteAll(int fd, struct iovec *iov, int count) {
+  while (count > 0) {
+    const ssize_t n = writev(fd, iov, std::min(count, IOV_MAX));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    size_t left = n;
+    while (count > 0 && left >= iov->iov_len) {
+      left -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = static_cast<char *>(iov->iov_base) + left;
+      iov->iov_len -= left;
+    }
+  }
+  return true;
+}
+
+// Storage row of the frame's row number row counted from the top.
+const unsigned char *TopDownRow(const TGAImage &frame, int row) {
+  const size_t bytes_per_line =
+      static_cast<size_t>(frame.width()) * frame.bytes_per_pixel();
+  if (frame.row_order() == TGAImage::RowOrder::kBottomUp)
+    row = frame.height() - 1 - row;
+  return frame.data() + row * bytes_per_line;
+}
+
+// Maps the whole of the shared memory object fd.
+SharedMemoryRingHeader *MapSegment(int fd, size_t bytes) {
+  void *p = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  return p == MAP_FAILED ? nullptr : static_cast<SharedMemoryRingHeader *>(p);
+}
+} // namespace
+
+TgaFileSink::TgaFileSink(std::string pattern, bool rle)
+    : pattern_(std::move(pattern)), rle_(rle) {}
+
+bool TgaFileSink::Write(const TGAImage &frame, int index) {
+  char filename[4096];
+  std::snprintf(filename, sizeof(filename), pattern_.c_str(), index);
+  return frame.WriteTgaFile(filename, rle_);
+}
+
+RawFdSink::RawFdSink(int fd) : fd_(fd) {}
+
+bool RawFdSink::Write(const TGAImage &frame, int) {
+  if (!frame.data())
+    return false;
+  const size_t bytes_per_line =
+      static_cast<size_t>(frame.width()) * frame.bytes_per_pixel();
+  rows_.resize(frame.height());
+  for (int y = 0; y < frame.height(); y++) {
+    rows_[y].iov_base = const_cast<unsigned char *>(TopDownRow(frame, y));
+    rows_[y].iov_len = bytes_per_line;
+  }
+  return WriteAll(fd_, rows_.data(), frame.height());
+}
+
+SharedMemoryRingSink::SharedMemoryRingSink(std::string name, int width,
+                                           int height, int bpp, int slots,
+                                           std::chrono::milliseconds timeout)
+    : name_(std::move(name)), timeout_(timeout) {
+  if (width <= 0 || height <= 0 || bpp <= 0 || slots <= 0)
+    return;
+  // Slots start on cache lines so neither side shares one with the other.
+  const uint64_t frame_bytes = static_cast<uint64_t>(width) * height * bpp;
+  const uint64_t slot_bytes =
+      sizeof(SharedMemoryRingSlot) + (frame_bytes + 63) / 64 * 64;
+  const size_t bytes = sizeof(SharedMemoryRingHeader) + slots * slot_bytes;
+  // Exclusive, so a second sink cannot truncate a ring another one is
+  // still writing under the same name.
+  const int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0)
+    return;
+  SharedMemoryRingHeader *header =
+      ftruncate(fd, bytes) == 0 ? MapSegment(fd, bytes) : nullptr;
+  close(fd);
+  if (!header) {
+    shm_unlink(name_.c_str());
+    return;
+  }
+  new (header) SharedMemoryRingHeader();
+  header->width = width;
+  header->height = height;
+  header->bytes_per_pixel = bpp;
+  header->slots = slots;
+  header->slot_bytes = slot_bytes;
+  // Readers check the magic before trusting anything else.
+  header->magic.store(kRingMagic, std::memory_order_release);
+  header_ = header;
+  bytes_ = bytes;
+}
+
+SharedMemoryRingSink::~SharedMemoryRingSink() {
+  if (!header_)
+    return;
+  header_->ended.store(1, std::memory_order_release);
+  munmap(header_, bytes_);
+  shm_unlink(name_.c_str());
+}
+
+bool SharedMemoryRingSink::Write(const TGAImage &frame, int index) {
+  if (!header_ || !frame.data() ||
+      frame.width() != static_cast<int>(header_->width) ||
+      frame.height() != static_cast<int>(header_->height) ||
+      frame.bytes_per_pixel() != static_cast<int>(header_->bytes_per_pixel))
+    return false;
+  const uint64_t n = header_->written.load(std::memory_order_relaxed);
+  uint64_t released = header_->released.load(std::memory_order_acquire);
+  if (n - released >= header_->slots) {
+    if (stalled_ && released == stalled_released_)
+      return false;
+    const auto deadline = std::chrono::steady_clock::now() + timeout_;
+    while (n - released >= header_->slots) {
+      if (std::chrono::steady_clock::now() >= deadline) {
+        stalled_ = true;
+        stalled_released_ = released;
+        return false;
+      }
+      Pause();
+      released = header_->released.load(std::memory_order_acquire);
+    }
+  }
+  stalled_ = false;
+  const size_t bytes_per_line =
+      static_cast<size_t>(frame.width()) * frame.bytes_per_pixel();
+  SharedMemoryRingSlot *slot = header_->slot(n);
+  slot->index = index;
+  for (int y = 0; y < frame.height(); y++)
+    memcpy(slot->pixels() + y * bytes_per_line, TopDownRow(frame, y),
+           bytes_per_line);
+  header_->written.store(n + 1, std::memory_order_release);
+  return true;
+}
+
+SharedMemoryRingReader::SharedMemoryRingReader(const std::string &name) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0)
+    return;
+  struct stat st;
+  SharedMemoryRingHeader *header = nullptr;
+  if (fstat(fd, &st) == 0 &&
+      static_cast<size_t>(st.st_size) >= sizeof(SharedMemoryRingHeader))
+    header = MapSegment(fd, st.st_size);
+  close(fd);
+  if (!header)
+    return;
+  if (header->magic.load(std::memory_order_acquire) != kRingMagic ||
+      sizeof(*header) + header->slots * header->slot_bytes >
+          static_cast<size_t>(st.st_size)) {
+    munmap(header, st.st_size);
+    return;
+  }
+  header_ = header;
+  bytes_ = st.st_size;
+}
+
+SharedMemoryRingReader::~SharedMemoryRingReader() {
+  if (header_)
+    munmap(header_, bytes_);
+}
+
+int SharedMemoryRingReader::width() const {
+  return header_ ? header_->width : 0;
+}
+
+int SharedMemoryRingReader::height() const {
+  return header_ ? header_->height : 0;
+}
+
+int SharedMemoryRingReader::bytes_per_pixel() const {
+  return header_ ? header_->bytes_per_pixel : 0;
+}
+
+const unsigned char *SharedMemoryRingReader::Acquire(int *index) {
+  if (!header_)
+    return nullptr;
+  const uint64_t next = header_->released.load(std::memory_order_relaxed);
+  while (header_->written.load(std::memory_order_acquire) == next) {
+    // The sink marks the end after its last frame, so a frame published
+    // before the mark is seen by the second look.
+    if (header_->ended.load(std::memory_order_acquire) &&
+        header_->written.load(std::memory_order_acquire) == next)
+      return nullptr;
+    Pause();
+  }
+  SharedMemoryRingSlot *slot = header_->slot(next);
+  if (index)
+    *index = static_cast<int>(slot->index);
+  return slot->pixels();
+}
+
+void SharedMemoryRingReader::Release() {
+  if (header_)
+    header_->released.fetch_add(1, std::memory_order_release);
+}
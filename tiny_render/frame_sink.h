@@ -0,0 +1,121 @@
+#ifndef GRAPHICS_TINY_READER_FRAME_SINK_H_
+#define GRAPHICS_TINY_READER_FRAME_SINK_H_
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "tga_image.h"
+
+struct SharedMemoryRingHeader;
+
+// Destination of a sequence of finished frames, numbered from 0. Sinks read
+// a frame's rows in the order its row_order() gives, so rendered frames are
+// passed as they are, bottom row first, without flipping them.
+class FrameSink {
+public:
+  virtual ~FrameSink() = default;
+
+  // Delivers frame number index; false if it could not be delivered.
+  virtual bool Write(const TGAImage &frame, int index) = 0;
+  // Whether Write must be called one frame at a time in index order, as
+  // streams need. Sinks that return false accept concurrent calls.
+  virtual bool ordered() const { return true; }
+};
+
+// One TGA file per frame, named by a printf pattern taking the index, such
+// as "orbit_%03d.tga".
+class TgaFileSink : public FrameSink {
+public:
+  explicit TgaFileSink(std::string pattern, bool rle = true);
+
+  bool Write(const TGAImage &frame, int index) override;
+  bool ordered() const override { return false; }
+
+private:
+  std::string pattern_;
+  bool rle_;
+};
+
+// Headerless frames written straight from the image's storage to a file
+// descriptor such as stdout or a pipe: rows top first, pixels in stored byte
+// order (bgr24, bgra or gray8 to an encoder). The rows are gathered with
+// writev, so nothing is copied or flipped. The descriptor is not closed.
+class RawFdSink : public FrameSink {
+public:
+  explicit RawFdSink(int fd);
+
+  bool Write(const TGAImage &frame, int index) override;
+
+private:
+  int fd_;
+  std::vector<struct iovec> rows_;
+};
+
+// Frames published through a POSIX shared-memory ring of slots, for a
+// consumer process to map with SharedMemoryRingReader. Each frame is copied
+// once, rows top first, into the next free slot along with its index; Write
+// waits while every slot holds a frame the reader has not released, and
+// fails once no slot has been released for timeout, so a missing or dead
+// reader cannot hang the producer. The segment is created on construction,
+// failing if the name already exists, and unlinked on destruction after
+// marking the stream ended; readers that have it open keep their mapping.
+class SharedMemoryRingSink : public FrameSink {
+public:
+  // name is a shm_open name ("/something"); every frame must be
+  // width x height x bpp.
+  SharedMemoryRingSink(
+      std::string name, int width, int height, int bpp, int slots = 4,
+      std::chrono::milliseconds timeout = std::chrono::seconds(5));
+  ~SharedMemoryRingSink() override;
+  SharedMemoryRingSink(const SharedMemoryRingSink &) = delete;
+  SharedMemoryRingSink &operator=(const SharedMemoryRingSink &) = delete;
+
+  // False if the segment could not be created, as when another ring, or a
+  // stale one left by a killed producer, has the name.
+  bool ok() const { return header_ != nullptr; }
+
+  bool Write(const TGAImage &frame, int index) override;
+
+private:
+  std::string name_;
+  SharedMemoryRingHeader *header_ = nullptr;
+  size_t bytes_ = 0;
+  std::chrono::milliseconds timeout_;
+  // Set by a timed out Write, with the reader's released count then; later
+  // writes fail at once until the reader moves on.
+  bool stalled_ = false;
+  uint64_t stalled_released_ = 0;
+};
+
+// The consuming end of a SharedMemoryRingSink. Frames are used in place:
+// Acquire returns the next frame's pixels, valid until Release.
+class SharedMemoryRingReader {
+public:
+  // Fails (ok() false) if no sink has set the segment up yet.
+  explicit SharedMemoryRingReader(const std::string &name);
+  ~SharedMemoryRingReader();
+  SharedMemoryRingReader(const SharedMemoryRingReader &) = delete;
+  SharedMemoryRingReader &operator=(const SharedMemoryRingReader &) = delete;
+
+  bool ok() const { return header_ != nullptr; }
+  int width() const;
+  int height() const;
+  int bytes_per_pixel() const;
+
+  // Waits for the next frame; nullptr once the stream has ended and every
+  // frame has been read. If index is not null it is set to the index the
+  // frame was written with, which skips where the sink dropped frames.
+  const unsigned char *Acquire(int *index = nullptr);
+  // Hands the acquired frame's slot back to the producer.
+  void Release();
+
+private:
+  SharedMemoryRingHeader *header_ = nullptr;
+  size_t bytes_ = 0;
+};
+
+#endif // GRAPHICS_TINY_READER_FRAME_SINK_H_
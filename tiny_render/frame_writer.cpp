@@ -0,0 +1,42 @@
+#include "frame_writer.h"
+
+#include <algorithm>
+
+AsyncFrameWriter::AsyncFrameWriter(FramebufferPool &pool, FrameSink &sink,
+                                   TaskScheduler &scheduler,
+                                   size_t max_queued)
+    : pool_(pool), sink_(sink), scheduler_(scheduler),
+      max_queued_(std::max<size_t>(max_queued, 1)) {}
+
+AsyncFrameWriter::~AsyncFrameWriter() { Finish(); }
+
+void AsyncFrameWriter::Submit(TGAImage &&image) {
+  scheduler_.Wait(writes_, max_queued_ - 1);
+  {
+    std::lock_guard<std::mutex> lock(frames_mutex_);
+    frames_.push_back(Frame{std::move(image), submitted_++});
+  }
+  scheduler_.Spawn(writes_, [this] { WriteNext(); });
+}
+
+size_t AsyncFrameWriter::Finish() {
+  scheduler_.Wait(writes_);
+  return failed_;
+}
+
+void AsyncFrameWriter::WriteNext() {
+  // Tasks may start in any order, but each takes the oldest frame, so an
+  // ordered sink that is written under order_mutex_ sees them in order.
+  std::unique_lock<std::mutex> order(order_mutex_, std::defer_lock);
+  if (sink_.ordered())
+    order.lock();
+  Frame frame;
+  {
+    std::lock_guard<std::mutex> lock(frames_mutex_);
+    frame = std::move(frames_.front());
+    frames_.pop_front();
+  }
+  frame.image.DeclareRowOrder(TGAImage::RowOrder::kBottomUp);
+  failed_ += !sink_.Write(frame.image, frame.index);
+  pool_.Release(std::move(frame.image));
+}
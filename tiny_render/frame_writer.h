@@ -0,0 +1,55 @@
+#ifndef GRAPHICS_TINY_READER_FRAME_WRITER_H_
+#define GRAPHICS_TINY_READER_FRAME_WRITER_H_
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+#include "frame_sink.h"
+#include "framebuffer_pool.h"
+#include "task_scheduler.h"
+#include "tga_image.h"
+
+// Hands finished frames to a FrameSink as tasks on scheduler, then gives
+// their storage back to a FramebufferPool. At most max_queued frames are
+// waiting for or in the middle of a write, so together with the frame being
+// rendered the number of live render targets stays bounded; max_queued = 1
+// double buffers the renderer. Ordered sinks get the frames one at a time in
+// submission order, whichever threads run the tasks.
+class AsyncFrameWriter {
+public:
+  AsyncFrameWriter(FramebufferPool &pool, FrameSink &sink,
+                   TaskScheduler &scheduler, size_t max_queued = 1);
+  ~AsyncFrameWriter();
+
+  // Takes ownership of the next frame, stored bottom row first as rendered.
+  // Runs queued tasks on the calling thread while max_queued frames are
+  // already pending.
+  void Submit(TGAImage &&image);
+  // Waits for every submitted frame to be written. Returns the number of
+  // frames that failed to write.
+  size_t Finish();
+
+private:
+  struct Frame {
+    TGAImage image;
+    int index;
+  };
+
+  // Writes the oldest submitted frame; one task runs this per frame.
+  void WriteNext();
+
+  FramebufferPool &pool_;
+  FrameSink &sink_;
+  TaskScheduler &scheduler_;
+  size_t max_queued_;
+  int submitted_ = 0;
+  std::mutex frames_mutex_;
+  std::deque<Frame> frames_;
+  // Held from taking a frame until it is written for ordered sinks.
+  std::mutex order_mutex_;
+  TaskGroup writes_;
+  std::atomic<size_t> failed_ = 0;
+};
+
+#endif // GRAPHICS_TINY_READER_FRAME_WRITER_H_
@@ -0,0 +1,40 @@
+#include "framebuffer_pool.h"
+
+#include <utility>
+
+FramebufferPool::FramebufferPool(size_t max_free) : max_free_(max_free) {
+  free_.reserve(max_free_);
+}
+
+TGAImage FramebufferPool::Acquire(int width, int height, int bpp) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (size_t i = 0; i < free_.size(); i++) {
+      if (free_[i].width() == width && free_[i].height() == height &&
+          free_[i].bytes_per_pixel() == bpp) {
+        TGAImage image = std::move(free_[i]);
+        std::swap(free_[i], free_.back());
+        free_.pop_back();
+        image.Clear();
+        // The last user may have declared its rows bottom-up.
+        image.DeclareRowOrder(TGAImage::RowOrder::kTopDown);
+        return image;
+      }
+    }
+  }
+  return TGAImage(width, height, bpp);
+}
+
+void FramebufferPool::Release(TGAImage &&image) {
+  if (!image.data())
+    return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (free_.size() < max_free_) {
+    free_.push_back(std::move(image));
+  }
+}
+
+size_t FramebufferPool::free_count() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return free_.size();
+}
@@ -0,0 +1,30 @@
+#ifndef GRAPHICS_TINY_READER_FRAMEBUFFER_POOL_H_
+#define GRAPHICS_TINY_READER_FRAMEBUFFER_POOL_H_
+
+#include <mutex>
+#include <vector>
+
+#include "tga_image.h"
+
+// Recycles render targets between frames. Once a frame of a given size has
+// been released, acquiring another one of that size reuses its pixel storage
+// instead of going back to the heap.
+class FramebufferPool {
+public:
+  explicit FramebufferPool(size_t max_free = 8);
+
+  // Returns a cleared, top-down image of the requested layout, as a new
+  // TGAImage would be.
+  TGAImage Acquire(int width, int height, int bpp);
+  // Hands an image back for reuse; images beyond max_free are dropped.
+  void Release(TGAImage &&image);
+
+  size_t free_count();
+
+private:
+  std::mutex mutex_;
+  std::vector<TGAImage> free_;
+  size_t max_free_;
+};
+
+#endif // GRAPHICS_TINY_READER_FRAMEBUFFER_POOL_H_
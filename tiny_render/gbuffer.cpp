@@ -0,0 +1,92 @@
+#include "gbuffer.h"
+
+#include <algorithm>
+
+#include "profiler.h"
+#include "rasterizer.h"
+
+GBuffer::GBuffer(int width, int height)
+    : width_(width), height_(height),
+      depth_(width, height), normal_(static_cast<size_t>(width) * height),
+      albedo_(normal_.size()), face_id_(normal_.size()) {
+  Clear();
+}
+
+void GBuffer::Clear() {
+  depth_.Clear();
+  std::fill(face_id_.begin(), face_id_.end(), kNoFace);
+}
+
+bool GBuffer::DrawFace(const Matrix &transform, const Vec3f world_coords[3],
+                       const Vec2i uv[3], const TGAImage &texture,
+                       uint32_t face_id) {
+  PROFILE_COUNT(kTrianglesSubmitted, 1);
+  Vec3f screen_coords[3];
+  {
+    PROFILE_SCOPE(kTransform);
+    for (int j = 0; j < 3; j++)
+      screen_coords[j] = transform.TransformPoint(world_coords[j]);
+  }
+  Vec3f n;
+  {
+    PROFILE_SCOPE(kCull);
+    // Counter-clockwise on screen is front facing; the viewport keeps the
+    // orientation of normalized device coordinates.
+    const Vec3f &a = screen_coords[0];
+    const Vec3f &b = screen_coords[1];
+    const Vec3f &c = screen_coords[2];
+    const float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if (!(area > 0)) {
+      PROFILE_COUNT(kTrianglesCulled, 1);
+      return false;
+    }
+    n = (world_coords[2] - world_coords[0]) ^
+        (world_coords[1] - world_coords[0]);
+    n.Normalize();
+  }
+  PROFILE_SCOPE(kRaster);
+  RasterizeTriangle(screen_coords[0], screen_coords[1], screen_coords[2], uv[0],
+                    uv[1], uv[2], TileRect{0, 0, width_, height_}, depth_,
+                    [&](int x, int y, const Vec2i &texel) {
+                      const size_t idx = x + static_cast<size_t>(y) * width_;
+                      PROFILE_COUNT(kTextureFetches, 1);
+                      albedo_[idx] = texture.Get(texel.x, texel.y).val;
+                      normal_[idx] = n;
+                      face_id_[idx] = face_id;
+                    });
+  return true;
+}
+
+void GBuffer::Draw(const Model &model, const Matrix &transform) {
+  for (size_t i = 0; i < model.nfaces(); i++) {
+    const std::array<size_t, 3> face = model.face(i);
+    Vec3f world_coords[3];
+    Vec2i uv[3];
+    for (int j = 0; j < 3; j++) {
+      world_coords[j] = model.vert(face[j]);
+      uv[j] = model.uv(i, j);
+    }
+    DrawFace(transform, world_coords, uv, model.diffuse_map(),
+             static_cast<uint32_t>(i));
+  }
+}
+
+void GBuffer::Shade(std::span<const Light> lights, TGAImage &image) const {
+  for (int y = 0; y < height_; y++) {
+    for (int x = 0; x < width_; x++) {
+      const size_t idx = x + static_cast<size_t>(y) * width_;
+      if (face_id_[idx] == kNoFace) {
+        image.Set(x, y, TGAColor(0, 0, 0));
+        continue;
+      }
+      float intensity = 0.f;
+      for (const Light &light : lights)
+        intensity += std::max(0.f, normal_[idx] * light.dir) * light.intensity;
+      intensity = std::min(intensity, 1.f);
+      const TGAColor color(albedo_[idx], TGAImage::RGBA);
+      image.Set(x, y,
+                TGAColor(color.r * intensity, color.g * intensity,
+                         color.b * intensity));
+    }
+  }
+}
@@ -0,0 +1,60 @@
+#ifndef GRAPHICS_TINY_READER_GBUFFER_H_
+#define GRAPHICS_TINY_READER_GBUFFER_H_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "tga_image.h"
+
+struct Light {
+  Vec3f dir;
+  float intensity = 1.f;
+};
+
+// Deferred shading target. The geometry pass rasterizes a model once and
+// keeps, per pixel, the depth, the unit face normal, the texel colour and the
+// face index; Shade then lights the whole image from those alone, so changing
+// the lights costs one pass over the pixels instead of a full render.
+class GBuffer {
+public:
+  static constexpr uint32_t kNoFace = 0xffffffff;
+
+  GBuffer(int width, int height);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+
+  void Clear();
+
+  // Rasterizes one face with object-space vertices and texel uvs, unless it
+  // faces away from the camera. Unlike DrawFace, culling cannot depend on
+  // the light, which is not known yet. Returns false if the face was culled.
+  bool DrawFace(const Matrix &transform, const Vec3f world_coords[3],
+                const Vec2i uv[3], const TGAImage &texture, uint32_t face_id);
+  void Draw(const Model &model, const Matrix &transform);
+
+  // Flat Lambert lighting from the sum of lights, clamped to the albedo.
+  // Pixels no face covers, or that no light reaches, are black.
+  void Shade(std::span<const Light> lights, TGAImage &image) const;
+
+  const DepthBuffer &depth() const { return depth_; }
+  const Vec3f &normal(int x, int y) const { return normal_[x + y * width_]; }
+  TGAColor albedo(int x, int y) const {
+    return TGAColor(albedo_[x + y * width_], TGAImage::RGBA);
+  }
+  uint32_t face_id(int x, int y) const { return face_id_[x + y * width_]; }
+
+private:
+  int width_;
+  int height_;
+  DepthBuffer depth_;
+  std::vector<Vec3f> normal_;
+  std::vector<uint32_t> albedo_;
+  std::vector<uint32_t> face_id_;
+};
+
+#endif // GRAPHICS_TINY_READER_GBUFFER_H_
@@ -33,7 +33,7 @@ std::vector<float> &Matrix::operator[](const int i) {
   return m[i];
 }
 
-Matrix Matrix::operator*(const Matrix &a) {
+Matrix Matrix::operator*(const Matrix &a) const {
   assert(cols == a.rows);
   Matrix result(rows, a.cols);
   for (int i = 0; i < rows; i++) {
@@ -97,6 +97,21 @@ Matrix Matrix::Inverse() {
   return truncate;
 }
 
+Vec3f Matrix::TransformPoint(const Vec3f &v, float *w) const {
+  assert(rows == 4 && cols == 4);
+  float r[4];
+  for (int i = 0; i < 4; i++) {
+    r[i] = 0.f;
+    r[i] += m[i][0] * v.x;
+    r[i] += m[i][1] * v.y;
+    r[i] += m[i][2] * v.z;
+    r[i] += m[i][3] * 1.f;
+  }
+  if (w)
+    *w = r[3];
+  return Vec3f(r[0] / r[3], r[1] / r[3], r[2] / r[3]);
+}
+
 std::ostream &operator<<(std::ostream &s, Matrix &m) {
   for (int i = 0; i < m.nrows(); i++) {
     for (int j = 0; j < m.ncols(); j++) {
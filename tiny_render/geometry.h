@@ -56,7 +56,7 @@ template <typename t> struct Vec3 {
   };
   Vec3() : x(0), y(0), z(0) {}
   Vec3(t _x, t _y, t _z) : x(_x), y(_y), z(_z) {}
-  template <typename u> Vec3<t>(const Vec3<u> &v);
+  template <typename u> Vec3(const Vec3<u> &v);
   inline Vec3<t> operator^(const Vec3<t> &v) const {
     return Vec3<t>(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x);
   }
@@ -113,9 +113,13 @@ public:
 
   static Matrix Identity(int dimensions);
   std::vector<float> &operator[](const int i);
-  Matrix operator*(const Matrix &a);
+  Matrix operator*(const Matrix &a) const;
+  bool operator==(const Matrix &a) const { return m == a.m; }
   Matrix Transpose();
   Matrix Inverse();
+  // Applies a 4x4 transform to the point (v, 1) and divides by w, without
+  // allocating the intermediate 4x1 matrix. The undivided w goes to *w.
+  Vec3f TransformPoint(const Vec3f &v, float *w = nullptr) const;
 
   friend std::ostream &operator<<(std::ostream &s, Matrix &m);
 
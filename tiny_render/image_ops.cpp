@@ -0,0 +1,281 @@
+#include "image_ops.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+void Reshape(TGAImage &dst, int width, int height, int bpp,
+             TGAImage::RowOrder order) {
+  if (!dst.data() || dst.width() != width || dst.height() != height ||
+      dst.bytes_per_pixel() != bpp || dst.row_order() != order)
+    dst = TGAImage(width, height, bpp, order);
+}
+
+bool ValidFormat(int bpp) {
+  return bpp == TGAImage::GRAYSCALE || bpp == TGAImage::RGB ||
+         bpp == TGAImage::RGBA;
+}
+
+void SwapPixels(unsigned char *a, unsigned char *b, int bpp) {
+  for (int c = 0; c < bpp; c++)
+    std::swap(a[c], b[c]);
+}
+
+#ifdef __SSE2__
+// Reverses the 16 bytes of v.
+__m128i ReverseBytes(__m128i v) {
+  v = _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+  v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+  return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+// Reverses the four 32-bit lanes of v.
+__m128i ReverseDwords(__m128i v) {
+  return _mm_shuffle_epi32(v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+// Mirrors a row of single-byte or four-byte pixels 16 bytes at a time from
+// both ends; the middle is left to the scalar loop. Returns the number of
+// pixels swapped from each end.
+int MirrorRowSse2(unsigned char *row, int width, int bpp) {
+  const int step = 16 / bpp;
+  int left = 0;
+  int right = width;
+  while (right - left >= 2 * step) {
+    __m128i *l = reinterpret_cast<__m128i *>(row + left * bpp);
+    __m128i *r = reinterpret_cast<__m128i *>(row + (right - step) * bpp);
+    const __m128i a = _mm_loadu_si128(l);
+    const __m128i b = _mm_loadu_si128(r);
+    _mm_storeu_si128(l, bpp == 1 ? ReverseBytes(b) : ReverseDwords(b));
+    _mm_storeu_si128(r, bpp == 1 ? ReverseBytes(a) : ReverseDwords(a));
+    left += step;
+    right -= step;
+  }
+  return left;
+}
+#endif
+
+// The float kernel of DepthToGray over n floats stored at z.
+void FloatsToGray(const unsigned char *z, size_t n, float lo, float scale,
+                  unsigned char *out) {
+  size_t i = 0;
+#ifdef __SSE2__
+  const __m128 vlo = _mm_set1_ps(lo);
+  const __m128 vscale = _mm_set1_ps(scale);
+  const __m128 vmax = _mm_set1_ps(255.f);
+  const __m128 half = _mm_set1_ps(.5f);
+  const auto level = [&](size_t first) {
+    // Unaligned vector loads may alias anything.
+    const __m128 depth =
+        _mm_loadu_ps(reinterpret_cast<const float *>(z) + first);
+    __m128 v = _mm_mul_ps(_mm_sub_ps(depth, vlo), vscale);
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), vmax);
+    return _mm_cvttps_epi32(_mm_add_ps(v, half));
+  };
+  for (; i + 16 <= n; i += 16) {
+    const __m128i a = _mm_packs_epi32(level(i), level(i + 4));
+    const __m128i b = _mm_packs_epi32(level(i + 8), level(i + 12));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     _mm_packus_epi16(a, b));
+  }
+#endif
+  for (; i < n; i++) {
+    const float v =
+        std::clamp((LoadValue<float>(z, i) - lo) * scale, 0.f, 255.f);
+    out[i] = static_cast<unsigned char>(v + .5f);
+  }
+}
+} // namespace
+
+void FlipPixelsVertically(unsigned char *data, int width, int height,
+                          int bpp) {
+  const size_t bytes_per_line = static_cast<size_t>(width) * bpp;
+  for (int j = 0; j < height / 2; j++) {
+    unsigned char *a = data + j * bytes_per_line;
+    unsigned char *b = data + (height - 1 - j) * bytes_per_line;
+    size_t i = 0;
+#ifdef __SSE2__
+    for (; i + 16 <= bytes_per_line; i += 16) {
+      __m128i *pa = reinterpret_cast<__m128i *>(a + i);
+      __m128i *pb = reinterpret_cast<__m128i *>(b + i);
+      const __m128i va = _mm_loadu_si128(pa);
+      _mm_storeu_si128(pa, _mm_loadu_si128(pb));
+      _mm_storeu_si128(pb, va);
+    }
+#endif
+    std::swap_ranges(a + i, a + bytes_per_line, b + i);
+  }
+}
+
+void FlipPixelsHorizontally(unsigned char *data, int width, int height,
+                            int bpp) {
+  for (int j = 0; j < height; j++) {
+    unsigned char *row = data + static_cast<size_t>(j) * width * bpp;
+    int left = 0;
+#ifdef __SSE2__
+    if (bpp == 1 || bpp == 4)
+      left = MirrorRowSse2(row, width, bpp);
+#endif
+    for (int right = width - 1 - left; left < right; left++, right--)
+      SwapPixels(row + left * bpp, row + right * bpp, bpp);
+  }
+}
+
+bool DownscaleBox(const TGAImage &src, int factor, TGAImage &dst) {
+  if (!src.data() || factor <= 0)
+    return false;
+  const int bpp = src.bytes_per_pixel();
+  const int width = (src.width() + factor - 1) / factor;
+  const int height = (src.height() + factor - 1) / factor;
+  Reshape(dst, width, height, bpp, src.row_order());
+  const size_t src_line = static_cast<size_t>(src.width()) * bpp;
+  // Column sums of the block's rows, then sums across each block.
+  std::vector<uint32_t> columns(src_line);
+  for (int y = 0; y < height; y++) {
+    const int y0 = y * factor;
+    const int rows = std::min(factor, src.height() - y0);
+    std::fill(columns.begin(), columns.end(), 0);
+    for (int r = 0; r < rows; r++) {
+      const unsigned char *line = src.data() + (y0 + r) * src_line;
+      for (size_t i = 0; i < src_line; i++)
+        columns[i] += line[i];
+    }
+    unsigned char *out = dst.data() + static_cast<size_t>(y) * width * bpp;
+    for (int x = 0; x < width; x++) {
+      const int x0 = x * factor;
+      const int cols = std::min(factor, src.width() - x0);
+      const uint32_t count = rows * cols;
+      for (int c = 0; c < bpp; c++) {
+        uint32_t sum = 0;
+        for (int k = 0; k < cols; k++)
+          sum += columns[(x0 + k) * bpp + c];
+        out[x * bpp + c] = (sum + count / 2) / count;
+      }
+    }
+  }
+  return true;
+}
+
+bool ResizeBilinear(const TGAImage &src, int width, int height,
+                    TGAImage &dst) {
+  if (!src.data() || width <= 0 || height <= 0)
+    return false;
+  const int bpp = src.bytes_per_pixel();
+  Reshape(dst, width, height, bpp, src.row_order());
+  // Source pixel pairs and 8-bit weights of the second, per output column
+  // and row.
+  struct Tap {
+    int first;
+    int second;
+    uint32_t weight;
+  };
+  const auto taps = [](int out_size, int in_size) {
+    std::vector<Tap> taps(out_size);
+    const float ratio = static_cast<float>(in_size) / out_size;
+    for (int i = 0; i < out_size; i++) {
+      const float s =
+          std::clamp((i + .5f) * ratio - .5f, 0.f, in_size - 1.f);
+      const int first = static_cast<int>(s);
+      taps[i] = {first, std::min(first + 1, in_size - 1),
+                 static_cast<uint32_t>((s - first) * 256.f + .5f)};
+    }
+    return taps;
+  };
+  const std::vector<Tap> xs = taps(width, src.width());
+  const std::vector<Tap> ys = taps(height, src.height());
+  const size_t src_line = static_cast<size_t>(src.width()) * bpp;
+  std::vector<uint16_t> blended(src_line);
+  for (int y = 0; y < height; y++) {
+    // Vertical blend of the two source rows, a straight run of bytes.
+    const unsigned char *a = src.data() + ys[y].first * src_line;
+    const unsigned char *b = src.data() + ys[y].second * src_line;
+    const uint32_t wb = ys[y].weight;
+    const uint32_t wa = 256 - wb;
+    for (size_t i = 0; i < src_line; i++)
+      blended[i] = a[i] * wa + b[i] * wb;
+    unsigned char *out = dst.data() + static_cast<size_t>(y) * width * bpp;
+    for (int x = 0; x < width; x++) {
+      const uint16_t *p = &blended[xs[x].first * bpp];
+      const uint16_t *q = &blended[xs[x].second * bpp];
+      const uint32_t wq = xs[x].weight;
+      const uint32_t wp = 256 - wq;
+      for (int c = 0; c < bpp; c++)
+        out[x * bpp + c] = (p[c] * wp + q[c] * wq + 32768) >> 16;
+    }
+  }
+  return true;
+}
+
+bool ConvertFormat(const TGAImage &src, int bytes_per_pixel, TGAImage &dst) {
+  const int from = src.bytes_per_pixel();
+  const int to = bytes_per_pixel;
+  if (!src.data() || !ValidFormat(from) || !ValidFormat(to))
+    return false;
+  Reshape(dst, src.width(), src.height(), to, src.row_order());
+  const size_t n = static_cast<size_t>(src.width()) * src.height();
+  const unsigned char *in = src.data();
+  unsigned char *out = dst.data();
+  if (from == to) {
+    memcpy(out, in, n * to);
+  } else if (to == TGAImage::GRAYSCALE) {
+    // Bytes are stored b, g, r; the weights sum to 256 so white stays 255.
+    for (size_t i = 0; i < n; i++) {
+      const unsigned char *p = in + i * from;
+      out[i] = (29 * p[0] + 150 * p[1] + 77 * p[2] + 128) >> 8;
+    }
+  } else if (from == TGAImage::GRAYSCALE) {
+    for (size_t i = 0; i < n; i++) {
+      memset(out + i * to, in[i], 3);
+      if (to == TGAImage::RGBA)
+        out[i * 4 + 3] = 255;
+    }
+  } else if (to == TGAImage::RGBA) {
+    for (size_t i = 0; i < n; i++) {
+      out[i * 4] = in[i * 3];
+      out[i * 4 + 1] = in[i * 3 + 1];
+      out[i * 4 + 2] = in[i * 3 + 2];
+      out[i * 4 + 3] = 255;
+    }
+  } else {
+    for (size_t i = 0; i < n; i++) {
+      out[i * 3] = in[i * 4];
+      out[i * 3 + 1] = in[i * 4 + 1];
+      out[i * 3 + 2] = in[i * 4 + 2];
+    }
+  }
+  return true;
+}
+
+bool DepthToGray(const DepthBuffer &depth, float lo, float hi, TGAImage &dst) {
+  if (hi == lo)
+    return false;
+  const int width = depth.width();
+  const int height = depth.height();
+  Reshape(dst, width, height, TGAImage::GRAYSCALE, dst.row_order());
+  const float scale = 255.f / (hi - lo);
+  if (depth.format() == DepthFormat::kFloat32) {
+    FloatsToGray(depth.data(), static_cast<size_t>(width) * height, lo,
+                 scale, dst.data());
+    return true;
+  }
+  // Other formats are decoded a row at a time first.
+  std::vector<float> row(width);
+  VisitDepthFormat(depth.format(), [&](auto format) {
+    using Format = decltype(format);
+    for (int y = 0; y < height; y++) {
+      const size_t first = static_cast<size_t>(y) * width;
+      for (int x = 0; x < width; x++)
+        row[x] = Format::Decode(Format::Load(depth.data(), first + x));
+      FloatsToGray(reinterpret_cast<const unsigned char *>(row.data()),
+                   width, lo, scale, dst.data() + first);
+    }
+  });
+  return true;
+}
@@ -0,0 +1,38 @@
+#ifndef GRAPHICS_TINY_READER_IMAGE_OPS_H_
+#define GRAPHICS_TINY_READER_IMAGE_OPS_H_
+
+#include "depth_buffer.h"
+#include "tga_image.h"
+
+// Post-processing kernels over whole rows of packed pixels: SSE2 where the
+// pixel layout allows it, and otherwise plain byte loops the compiler
+// vectorizes. Kernels that write a dst image reallocate it only when its
+// size, format or row order differs, so a frame loop can reuse one image;
+// dst must not be the source.
+
+// Mirror width x height packed pixels of bpp bytes in place.
+void FlipPixelsVertically(unsigned char *data, int width, int height, int bpp);
+void FlipPixelsHorizontally(unsigned char *data, int width, int height,
+                            int bpp);
+
+// Averages each factor x factor block of src into one pixel of dst, which is
+// ceil(width / factor) x ceil(height / factor); blocks cut off by the edge
+// average the pixels they have.
+bool DownscaleBox(const TGAImage &src, int factor, TGAImage &dst);
+
+// Resamples src to width x height with bilinear filtering of pixel centres.
+// Good for enlarging or for reducing by less than 2x; larger reductions
+// alias, so go through DownscaleBox first.
+bool ResizeBilinear(const TGAImage &src, int width, int height,
+                    TGAImage &dst);
+
+// Converts between GRAYSCALE, RGB and RGBA. Gray is BT.601 luma, gray
+// expands to equal channels, and added alpha is opaque.
+bool ConvertFormat(const TGAImage &src, int bytes_per_pixel, TGAImage &dst);
+
+// Writes depth as a GRAYSCALE image with screen z lo black and hi white,
+// clamped and rounded to the nearest level. Rows keep the depth buffer's
+// order.
+bool DepthToGray(const DepthBuffer &depth, float lo, float hi, TGAImage &dst);
+
+#endif // GRAPHICS_TINY_READER_IMAGE_OPS_H_
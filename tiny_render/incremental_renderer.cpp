@@ -0,0 +1,157 @@
+#include "incremental_renderer.h"
+
+#include <algorithm>
+#include <array>
+
+#include "profiler.h"
+
+IncrementalRenderer::IncrementalRenderer(int width, int height, int tile_size,
+                                         DepthFormat format)
+    : tile_size_(tile_size), tiles_x_((width + tile_size - 1) / tile_size),
+      tiles_y_((height + tile_size - 1) / tile_size),
+      image_(width, height, TGAImage::RGB), depth_(width, height, format),
+      tile_instances_(static_cast<size_t>(tiles_x_) * tiles_y_),
+      dirty_(tile_instances_.size(), 0) {}
+
+TileRect IncrementalRenderer::TileClip(int tile) const {
+  const int tx = tile % tiles_x_;
+  const int ty = tile / tiles_x_;
+  return TileRect{tx * tile_size_, ty * tile_size_,
+                  std::min((tx + 1) * tile_size_, image_.width()),
+                  std::min((ty + 1) * tile_size_, image_.height())};
+}
+
+void IncrementalRenderer::MarkDirty(const TileRect &tiles) {
+  for (int ty = tiles.y0; ty < tiles.y1; ty++) {
+    for (int tx = tiles.x0; tx < tiles.x1; tx++)
+      dirty_[tx + ty * tiles_x_] = 1;
+  }
+}
+
+void IncrementalRenderer::Track(const InstancedScene &scene,
+                                InstancedScene::InstanceId i,
+                                const Matrix &view_projection) {
+  Drawn &drawn = drawn_[i];
+  if (drawn.visible) {
+    MarkDirty(drawn.tiles);
+    for (int ty = drawn.tiles.y0; ty < drawn.tiles.y1; ty++) {
+      for (int tx = drawn.tiles.x0; tx < drawn.tiles.x1; tx++) {
+        auto &list = tile_instances_[tx + ty * tiles_x_];
+        list.erase(std::find(list.begin(), list.end(), i));
+      }
+    }
+  }
+  drawn.visible = false;
+  if (i >= scene.ninstances())
+    return;
+  drawn.model = scene.model_of(i);
+  drawn.world = scene.world(i);
+  TileRect rect;
+  if (!InstanceScreenRect(scene.model(drawn.model), drawn.world,
+                          view_projection, image_.width(), image_.height(),
+                          rect))
+    return;
+  drawn.visible = true;
+  drawn.tiles = TileRect{rect.x0 / tile_size_, rect.y0 / tile_size_,
+                         (rect.x1 + tile_size_ - 1) / tile_size_,
+                         (rect.y1 + tile_size_ - 1) / tile_size_};
+  MarkDirty(drawn.tiles);
+  for (int ty = drawn.tiles.y0; ty < drawn.tiles.y1; ty++) {
+    for (int tx = drawn.tiles.x0; tx < drawn.tiles.x1; tx++)
+      tile_instances_[tx + ty * tiles_x_].push_back(i);
+  }
+}
+
+IncrementalStats IncrementalRenderer::Render(const InstancedScene &scene,
+                                             const Matrix &view_projection,
+                                             const Vec3f &light_dir) {
+  IncrementalStats stats;
+  stats.tiles = dirty_.size();
+  if (!valid_ || !(view_projection == view_projection_) ||
+      light_dir.x != light_dir_.x || light_dir.y != light_dir_.y ||
+      light_dir.z != light_dir_.z) {
+    // Everything is stale: forget the last frame.
+    for (auto &list : tile_instances_)
+      list.clear();
+    drawn_.clear();
+    std::fill(dirty_.begin(), dirty_.end(), 1);
+    view_projection_ = view_projection;
+    light_dir_ = light_dir;
+    valid_ = true;
+  }
+
+  // Instances past the end of the scene were removed.
+  const size_t known = drawn_.size();
+  const size_t tracked = std::max(known, scene.ninstances());
+  drawn_.resize(tracked, Drawn{0, Matrix(), false, TileRect{0, 0, 0, 0}});
+  {
+    PROFILE_SCOPE(kCull);
+    for (InstancedScene::InstanceId i = 0; i < tracked; i++) {
+      if (i < known && i < scene.ninstances() &&
+          drawn_[i].model == scene.model_of(i) &&
+          drawn_[i].world == scene.world(i))
+        continue;
+      stats.instances_changed++;
+      Track(scene, i, view_projection);
+    }
+  }
+  drawn_.resize(scene.ninstances());
+
+  // The instances listed for the dirty tiles, in DrawScene's order.
+  std::vector<InstancedScene::InstanceId> redraw;
+  for (size_t t = 0; t < dirty_.size(); t++) {
+    if (!dirty_[t])
+      continue;
+    stats.tiles_redrawn++;
+    ClearTile(TileClip(static_cast<int>(t)), depth_, image_);
+    redraw.insert(redraw.end(), tile_instances_[t].begin(),
+                  tile_instances_[t].end());
+  }
+  std::sort(redraw.begin(), redraw.end(),
+            [&](InstancedScene::InstanceId a, InstancedScene::InstanceId b) {
+              return scene.model_of(a) != scene.model_of(b)
+                         ? scene.model_of(a) < scene.model_of(b)
+                         : a < b;
+            });
+  redraw.erase(std::unique(redraw.begin(), redraw.end()), redraw.end());
+  stats.instances_drawn = redraw.size();
+
+  // Each instance is transformed once, and each face drawn through every
+  // dirty tile its rectangle touches; a pixel sees the same faces in the
+  // same order as in a full redraw, which makes the result identical.
+  InstanceVertices vertices;
+  for (InstancedScene::InstanceId i : redraw) {
+    const Model &model = scene.model(drawn_[i].model);
+    TransformInstance(model, drawn_[i].world, view_projection, vertices);
+    const TileRect &tiles = drawn_[i].tiles;
+    PROFILE_SCOPE(kRaster);
+    for (size_t f = 0; f < model.nfaces(); f++) {
+      const float intensity = FaceIntensity(model, vertices, f, light_dir);
+      if (!(intensity > 0))
+        continue;
+      const std::array<size_t, 3> face = model.face(f);
+      TileRect face_tiles;
+      if (!TriangleTiles(vertices.screen[face[0]], vertices.screen[face[1]],
+                         vertices.screen[face[2]], tile_size_, tiles_x_,
+                         tiles_y_, face_tiles))
+        continue;
+      const int tx0 = std::max(face_tiles.x0, tiles.x0);
+      const int ty0 = std::max(face_tiles.y0, tiles.y0);
+      const int tx1 = std::min(face_tiles.x1, tiles.x1);
+      const int ty1 = std::min(face_tiles.y1, tiles.y1);
+      for (int ty = ty0; ty < ty1; ty++) {
+        for (int tx = tx0; tx < tx1; tx++) {
+          const int t = tx + ty * tiles_x_;
+          if (!dirty_[t])
+            continue;
+          DrawTriangle(vertices.screen[face[0]], vertices.screen[face[1]],
+                       vertices.screen[face[2]], model.uv(f, 0),
+                       model.uv(f, 1), model.uv(f, 2), model.diffuse_map(),
+                       intensity, TileClip(t), depth_, image_);
+        }
+      }
+    }
+  }
+  std::fill(dirty_.begin(), dirty_.end(), 0);
+  return stats;
+}
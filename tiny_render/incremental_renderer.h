@@ -0,0 +1,71 @@
+#ifndef GRAPHICS_TINY_READER_INCREMENTAL_RENDERER_H_
+#define GRAPHICS_TINY_READER_INCREMENTAL_RENDERER_H_
+
+#include <vector>
+
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "instanced_scene.h"
+#include "rasterizer.h"
+#include "tga_image.h"
+
+struct IncrementalStats {
+  size_t instances_changed = 0;
+  size_t instances_drawn = 0;
+  size_t tiles_redrawn = 0;
+  size_t tiles = 0;
+};
+
+// Renders successive frames of an InstancedScene, keeping the last frame's
+// color and depth and, per tile_size square screen tile, the instances whose
+// screen rectangle touched it. An instance counts as changed when it is added
+// or removed or its model or world transform differs from the last frame;
+// only the tiles under a changed instance, where it was and where it is now,
+// are cleared and redrawn, by the instances listed for them. Every other tile
+// keeps its pixels. The image is the same as DrawScene's for each frame. A new
+// camera or light redraws every tile.
+class IncrementalRenderer {
+public:
+  IncrementalRenderer(int width, int height, int tile_size = 32,
+                      DepthFormat format = DepthFormat::kFloat32);
+
+  IncrementalStats Render(const InstancedScene &scene,
+                          const Matrix &view_projection,
+                          const Vec3f &light_dir);
+  // Makes the next Render redraw every tile.
+  void Invalidate() { valid_ = false; }
+
+  const TGAImage &image() const { return image_; }
+  const DepthBuffer &depth() const { return depth_; }
+
+private:
+  // What the last frame drew of one instance.
+  struct Drawn {
+    InstancedScene::ModelId model;
+    Matrix world;
+    bool visible;
+    // Tiles [x0, x1) x [y0, y1) its screen rectangle touches.
+    TileRect tiles;
+  };
+
+  // Updates drawn_ and tile_instances_ for instance i and marks the tiles
+  // it leaves and enters dirty.
+  void Track(const InstancedScene &scene, InstancedScene::InstanceId i,
+             const Matrix &view_projection);
+  void MarkDirty(const TileRect &tiles);
+  TileRect TileClip(int tile) const;
+
+  int tile_size_;
+  int tiles_x_;
+  int tiles_y_;
+  TGAImage image_;
+  DepthBuffer depth_;
+  bool valid_ = false;
+  Matrix view_projection_;
+  Vec3f light_dir_;
+  std::vector<Drawn> drawn_;
+  std::vector<std::vector<InstancedScene::InstanceId>> tile_instances_;
+  std::vector<char> dirty_;
+};
+
+#endif // GRAPHICS_TINY_READER_INCREMENTAL_RENDERER_H_
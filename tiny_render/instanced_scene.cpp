@@ -0,0 +1,279 @@
+#include "instanced_scene.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+#include "occlusion_query.h"
+#include "profiler.h"
+#include "rasterizer.h"
+
+namespace {
+// Fraction of a box's size added on every side for occlusion queries.
+constexpr float kQueryMargin = 0.01f;
+
+// Screen x and y (before the divide) and w of a point.
+struct ClipPoint {
+  float x;
+  float y;
+  float w;
+};
+
+ClipPoint ToClip(Matrix &transform, const Vec3f &p) {
+  ClipPoint c;
+  float *out[3] = {&c.x, &c.y, &c.w};
+  const int rows[3] = {0, 1, 3};
+  for (int i = 0; i < 3; i++) {
+    const std::vector<float> &row = transform[rows[i]];
+    *out[i] = row[0] * p.x + row[1] * p.y + row[2] * p.z + row[3];
+  }
+  return c;
+}
+
+// Transforms one instance into vertices and draws its faces.
+void DrawInstance(const Model &model, const Matrix &world,
+                  const Matrix &view_projection, const Vec3f &light_dir,
+                  InstanceVertices &vertices, DepthBuffer &depth,
+                  TGAImage &image) {
+  TransformInstance(model, world, view_projection, vertices);
+  const TGAImage &texture = model.diffuse_map();
+  PROFILE_SCOPE(kRaster);
+  for (size_t i = 0; i < model.nfaces(); i++) {
+    const float intensity = FaceIntensity(model, vertices, i, light_dir);
+    if (!(intensity > 0))
+      continue;
+    const std::array<size_t, 3> face = model.face(i);
+    DrawTriangle(vertices.screen[face[0]], vertices.screen[face[1]],
+                 vertices.screen[face[2]], model.uv(i, 0), model.uv(i, 1),
+                 model.uv(i, 2), texture, intensity, depth, image);
+  }
+}
+} // namespace
+
+Matrix PlaceObject(const Vec3f &position, float yaw, float scale) {
+  Matrix m = Matrix::Identity(4);
+  const float c = std::cos(yaw) * scale;
+  const float s = std::sin(yaw) * scale;
+  m[0][0] = c;
+  m[0][2] = s;
+  m[1][1] = scale;
+  m[2][0] = -s;
+  m[2][2] = c;
+  for (int i = 0; i < 3; i++)
+    m[i][3] = position[i];
+  return m;
+}
+
+InstancedScene::ModelId
+InstancedScene::AddModel(std::shared_ptr<const Model> model) {
+  models_.push_back(std::move(model));
+  return static_cast<ModelId>(models_.size() - 1);
+}
+
+InstancedScene::InstanceId InstancedScene::AddInstance(ModelId model,
+                                                       const Matrix &world) {
+  instances_.push_back({model, world});
+  return static_cast<InstanceId>(instances_.size() - 1);
+}
+
+void InstancedScene::SetWorld(InstanceId instance, const Matrix &world) {
+  instances_[instance].world = world;
+}
+
+bool FrustumCulled(const Model &model, const Matrix &world,
+                   const Matrix &view_projection, int width, int height) {
+  if (model.nfaces() == 0)
+    return true;
+  Matrix transform = view_projection * world;
+  const Vec3f lo = model.bbox_min();
+  const Vec3f hi = model.bbox_max();
+  // One bit per plane: x >= -1, x <= width + 1, y >= -1, y <= height + 1 and
+  // w > 0, with a pixel of margin for the rasterizer's rounding. The box is
+  // culled if every corner is outside one and the same plane.
+  unsigned outside = 0x1f;
+  for (int corner = 0; corner < 8 && outside; corner++) {
+    const Vec3f p(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y,
+                  corner & 4 ? hi.z : lo.z);
+    const ClipPoint c = ToClip(transform, p);
+    unsigned planes = 0;
+    planes |= (c.x < -c.w) << 0;
+    planes |= (c.x > (width + 1) * c.w) << 1;
+    planes |= (c.y < -c.w) << 2;
+    planes |= (c.y > (height + 1) * c.w) << 3;
+    planes |= (c.w <= 0.f) << 4;
+    outside &= planes;
+  }
+  return outside != 0;
+}
+
+bool InstanceScreenRect(const Model &model, const Matrix &world,
+                        const Matrix &view_projection, int width, int height,
+                        TileRect &rect) {
+  if (FrustumCulled(model, world, view_projection, width, height))
+    return false;
+  rect = TileRect{0, 0, width, height};
+  Matrix transform = view_projection * world;
+  const Vec3f lo = model.bbox_min();
+  const Vec3f hi = model.bbox_max();
+  float x0 = std::numeric_limits<float>::max();
+  float y0 = x0;
+  float x1 = -x0;
+  float y1 = -x0;
+  for (int corner = 0; corner < 8; corner++) {
+    const Vec3f p(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y,
+                  corner & 4 ? hi.z : lo.z);
+    const ClipPoint c = ToClip(transform, p);
+    if (c.w <= 0.f)
+      return true;
+    x0 = std::min(x0, c.x / c.w);
+    y0 = std::min(y0, c.y / c.w);
+    x1 = std::max(x1, c.x / c.w);
+    y1 = std::max(y1, c.y / c.w);
+  }
+  // Culling leaves the box overlapping the target, so these stay in range.
+  rect.x0 = std::max(static_cast<int>(std::floor(x0)) - 1, 0);
+  rect.y0 = std::max(static_cast<int>(std::floor(y0)) - 1, 0);
+  rect.x1 = std::min(static_cast<int>(std::ceil(x1)) + 2, width);
+  rect.y1 = std::min(static_cast<int>(std::ceil(y1)) + 2, height);
+  return true;
+}
+
+void TransformInstance(const Model &model, const Matrix &world,
+                       const Matrix &view_projection, InstanceVertices &out) {
+  PROFILE_SCOPE(kTransform);
+  out.world.resize(model.nverts());
+  out.screen.resize(model.nverts());
+  for (size_t v = 0; v < model.nverts(); v++) {
+    out.world[v] = world.TransformPoint(model.vert(v));
+    out.screen[v] = view_projection.TransformPoint(out.world[v]);
+  }
+}
+
+float FaceIntensity(const Model &model, const InstanceVertices &vertices,
+                    size_t face, const Vec3f &light_dir) {
+  PROFILE_COUNT(kTrianglesSubmitted, 1);
+  const std::array<size_t, 3> f = model.face(face);
+  const std::vector<Vec3f> &w = vertices.world;
+  Vec3f n = (w[f[2]] - w[f[0]]) ^ (w[f[1]] - w[f[0]]);
+  n.Normalize();
+  const float intensity = n * light_dir;
+  if (!(intensity > 0))
+    PROFILE_COUNT(kTrianglesCulled, 1);
+  return intensity;
+}
+
+std::vector<InstanceBatch> BatchInstances(const InstancedScene &scene,
+                                          const Matrix &view_projection,
+                                          int width, int height,
+                                          SceneStats *stats) {
+  std::vector<InstanceBatch> batches(scene.nmodels());
+  for (size_t m = 0; m < batches.size(); m++)
+    batches[m].model = static_cast<InstancedScene::ModelId>(m);
+  size_t culled = 0;
+  {
+    PROFILE_SCOPE(kCull);
+    for (InstancedScene::InstanceId i = 0; i < scene.ninstances(); i++) {
+      const InstancedScene::ModelId model = scene.model_of(i);
+      if (FrustumCulled(scene.model(model), scene.world(i), view_projection,
+                        width, height)) {
+        culled++;
+        continue;
+      }
+      batches[model].instances.push_back(i);
+    }
+  }
+  PROFILE_COUNT(kInstancesSubmitted, scene.ninstances());
+  PROFILE_COUNT(kInstancesCulled, culled);
+  batches.erase(std::remove_if(batches.begin(), batches.end(),
+                               [](const InstanceBatch &batch) {
+                                 return batch.instances.empty();
+                               }),
+                batches.end());
+  if (stats) {
+    stats->instances += scene.ninstances();
+    stats->frustum_culled += culled;
+    stats->batches += batches.size();
+  }
+  return batches;
+}
+
+void DrawBatches(const InstancedScene &scene,
+                 std::span<const InstanceBatch> batches,
+                 const Matrix &view_projection, const Vec3f &light_dir,
+                 DepthBuffer &depth, TGAImage &image) {
+  InstanceVertices vertices;
+  for (const InstanceBatch &batch : batches) {
+    for (InstancedScene::InstanceId instance : batch.instances) {
+      DrawInstance(scene.model(batch.model), scene.world(instance),
+                   view_projection, light_dir, vertices, depth, image);
+    }
+  }
+}
+
+SceneStats DrawScene(const InstancedScene &scene,
+                     const Matrix &view_projection, const Vec3f &light_dir,
+                     DepthBuffer &depth, TGAImage &image) {
+  SceneStats stats;
+  const std::vector<InstanceBatch> batches = BatchInstances(
+      scene, view_projection, image.width(), image.height(), &stats);
+  DrawBatches(scene, batches, view_projection, light_dir, depth, image);
+  return stats;
+}
+
+SceneStats DrawSceneOccluded(const InstancedScene &scene,
+                             const Matrix &view_projection,
+                             const Vec3f &light_dir, DepthBuffer &depth,
+                             TGAImage &image, size_t min_samples) {
+  SceneStats stats;
+  const std::vector<InstanceBatch> batches = BatchInstances(
+      scene, view_projection, image.width(), image.height(), &stats);
+  struct Candidate {
+    InstancedScene::InstanceId instance;
+    const Model *model;
+    Matrix transform;
+    // Screen z of the nearest box corner.
+    float near_z;
+  };
+  std::vector<Candidate> candidates;
+  for (const InstanceBatch &batch : batches) {
+    const Model &model = scene.model(batch.model);
+    const Vec3f lo = model.bbox_min();
+    const Vec3f hi = model.bbox_max();
+    for (InstancedScene::InstanceId instance : batch.instances) {
+      Candidate c{instance, &model, view_projection * scene.world(instance),
+                  -std::numeric_limits<float>::max()};
+      for (int corner = 0; corner < 8; corner++) {
+        const Vec3f p(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y,
+                      corner & 4 ? hi.z : lo.z);
+        float w;
+        const float z = c.transform.TransformPoint(p, &w).z;
+        c.near_z = w > 0.f ? std::max(c.near_z, z)
+                           : std::numeric_limits<float>::max();
+      }
+      candidates.push_back(std::move(c));
+    }
+  }
+  std::stable_sort(candidates.begin(), candidates.end(),
+                   [](const Candidate &a, const Candidate &b) {
+                     return a.near_z > b.near_z;
+                   });
+
+  InstanceVertices vertices;
+  for (const Candidate &c : candidates) {
+    // The rasterizer rounds the box to whole pixels and its depth to the
+    // buffer's format; growing it a little keeps the query conservative.
+    const Vec3f margin =
+        (c.model->bbox_max() - c.model->bbox_min()) * kQueryMargin;
+    if (QueryBox(c.model->bbox_min() - margin, c.model->bbox_max() + margin,
+                 c.transform, depth, min_samples) < min_samples) {
+      stats.occluded++;
+      continue;
+    }
+    DrawInstance(*c.model, scene.world(c.instance), view_projection,
+                 light_dir, vertices, depth, image);
+  }
+  PROFILE_COUNT(kInstancesOccluded, stats.occluded);
+  return stats;
+}
@@ -0,0 +1,125 @@
+#ifndef GRAPHICS_TINY_READER_INSTANCED_SCENE_H_
+#define GRAPHICS_TINY_READER_INSTANCED_SCENE_H_
+
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "rasterizer.h"
+#include "tga_image.h"
+
+// Object to world transform that scales by scale, turns by yaw radians about
+// the y axis and then moves the origin to position.
+Matrix PlaceObject(const Vec3f &position, float yaw = 0.f, float scale = 1.f);
+
+// Many instances of a few models, each placed in the world by its own object
+// to world transform. A model is held once however many instances use it, so
+// the scene costs one Matrix per instance on top of its assets.
+class InstancedScene {
+public:
+  using ModelId = uint32_t;
+  using InstanceId = uint32_t;
+
+  ModelId AddModel(std::shared_ptr<const Model> model);
+  InstanceId AddInstance(ModelId model, const Matrix &world);
+  void SetWorld(InstanceId instance, const Matrix &world);
+
+  size_t nmodels() const { return models_.size(); }
+  size_t ninstances() const { return instances_.size(); }
+  const Model &model(ModelId id) const { return *models_[id]; }
+  ModelId model_of(InstanceId instance) const {
+    return instances_[instance].model;
+  }
+  const Matrix &world(InstanceId instance) const {
+    return instances_[instance].world;
+  }
+
+private:
+  struct Instance {
+    ModelId model;
+    Matrix world;
+  };
+
+  std::vector<std::shared_ptr<const Model>> models_;
+  std::vector<Instance> instances_;
+};
+
+// The visible instances of one model, drawn one after another so the model's
+// arrays and texture stay in cache across them.
+struct InstanceBatch {
+  InstancedScene::ModelId model;
+  std::vector<InstancedScene::InstanceId> instances;
+};
+
+struct SceneStats {
+  size_t instances = 0;
+  size_t frustum_culled = 0;
+  size_t batches = 0;
+  size_t occluded = 0;
+};
+
+// True if the model's bounding box, placed by world and seen through
+// view_projection, is wholly outside the width x height target or behind the
+// camera. The box corners are tested against the frustum planes before the
+// perspective divide, so boxes that reach behind the camera are never culled
+// for falling off the wrong side of the screen.
+bool FrustumCulled(const Model &model, const Matrix &world,
+                   const Matrix &view_projection, int width, int height);
+
+// The pixels the instance can touch, as FrustumCulled sees it: false if it is
+// culled, else rect bounds its projected box (the whole target if the box
+// reaches behind the camera), with a pixel of margin for rounding.
+bool InstanceScreenRect(const Model &model, const Matrix &world,
+                        const Matrix &view_projection, int width, int height,
+                        TileRect &rect);
+
+// One instance's vertices in world space and on screen, kept across
+// instances so the arrays are allocated once.
+struct InstanceVertices {
+  std::vector<Vec3f> world;
+  std::vector<Vec3f> screen;
+};
+
+void TransformInstance(const Model &model, const Matrix &world,
+                       const Matrix &view_projection, InstanceVertices &out);
+
+// The light intensity of a face of a transformed instance, as TransformFace
+// computes it on world-space vertices; the face is culled unless it is > 0.
+float FaceIntensity(const Model &model, const InstanceVertices &vertices,
+                    size_t face, const Vec3f &light_dir);
+
+// Drops the frustum culled instances and groups the rest into one batch per
+// model, in model order with instances in id order within a batch.
+std::vector<InstanceBatch> BatchInstances(const InstancedScene &scene,
+                                          const Matrix &view_projection,
+                                          int width, int height,
+                                          SceneStats *stats = nullptr);
+
+// Draws the batches like DrawFace draws faces, with the lighting in world
+// space. Each instance's vertices are transformed once by TransformInstance
+// rather than three times per face.
+void DrawBatches(const InstancedScene &scene,
+                 std::span<const InstanceBatch> batches,
+                 const Matrix &view_projection, const Vec3f &light_dir,
+                 DepthBuffer &depth, TGAImage &image);
+
+// BatchInstances then DrawBatches for the whole image.
+SceneStats DrawScene(const InstancedScene &scene,
+                     const Matrix &view_projection, const Vec3f &light_dir,
+                     DepthBuffer &depth, TGAImage &image);
+
+// Like DrawScene, but the instances left after frustum culling are drawn
+// nearest first, each only if an occlusion query of its bounding box against
+// the depth drawn so far passes at least min_samples pixels. A hidden
+// instance costs a box query instead of its faces. The image is DrawScene's
+// except where instances drawn in another order meet at exactly equal depth.
+SceneStats DrawSceneOccluded(const InstancedScene &scene,
+                             const Matrix &view_projection,
+                             const Vec3f &light_dir, DepthBuffer &depth,
+                             TGAImage &image, size_t min_samples = 1);
+
+#endif // GRAPHICS_TINY_READER_INSTANCED_SCENE_H_
@@ -0,0 +1,110 @@
+#ifndef GRAPHICS_TINY_READER_LRU_CACHE_H_
+#define GRAPHICS_TINY_READER_LRU_CACHE_H_
+
+#include <cstdint>
+#include <filesystem>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct CacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  uint64_t evictions = 0;
+  size_t bytes = 0;
+  size_t entries = 0;
+};
+
+// Thread-safe least-recently-used cache of immutable assets, bounded by the
+// total size reported by size_of. Each entry carries the stamp (normally the
+// source file's modification time) it was loaded at; a lookup with a
+// different stamp reloads it. Concurrent lookups of a key that is being
+// loaded wait for that load instead of starting another.
+template <typename T> class LruCache {
+public:
+  using Stamp = std::filesystem::file_time_type;
+
+  LruCache(size_t capacity_bytes, size_t (*size_of)(const T &))
+      : capacity_(capacity_bytes), size_of_(size_of) {}
+
+  // Returns the cached value for key, calling load() on a miss. Failed loads
+  // (nullptr) are not cached.
+  template <typename Load>
+  std::shared_ptr<const T> Get(const std::string &key, Stamp stamp,
+                               Load load) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = entries_.find(key);
+    if (it != entries_.end() && it->second.stamp == stamp) {
+      stats_.hits++;
+      lru_.splice(lru_.begin(), lru_, it->second.position);
+      std::shared_future<std::shared_ptr<const T>> value = it->second.value;
+      lock.unlock();
+      return value.get();
+    }
+    if (it != entries_.end())
+      Erase(it);
+    stats_.misses++;
+    std::promise<std::shared_ptr<const T>> promise;
+    const uint64_t generation = ++generation_;
+    lru_.push_front(key);
+    entries_.emplace(key, Entry{stamp, promise.get_future().share(), 0,
+                                generation, lru_.begin()});
+    lock.unlock();
+
+    std::shared_ptr<const T> value = load();
+    promise.set_value(value);
+
+    lock.lock();
+    it = entries_.find(key);
+    // The entry may have been replaced or evicted while loading.
+    if (it == entries_.end() || it->second.generation != generation)
+      return value;
+    if (!value) {
+      Erase(it);
+      return value;
+    }
+    it->second.bytes = size_of_(*value);
+    stats_.bytes += it->second.bytes;
+    while (stats_.bytes > capacity_ && lru_.size() > 1) {
+      Erase(entries_.find(lru_.back()));
+      stats_.evictions++;
+    }
+    return value;
+  }
+
+  CacheStats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    CacheStats stats = stats_;
+    stats.entries = entries_.size();
+    return stats;
+  }
+
+private:
+  struct Entry {
+    Stamp stamp;
+    std::shared_future<std::shared_ptr<const T>> value;
+    size_t bytes;
+    uint64_t generation;
+    std::list<std::string>::iterator position;
+  };
+
+  void Erase(typename std::unordered_map<std::string, Entry>::iterator it) {
+    stats_.bytes -= it->second.bytes;
+    lru_.erase(it->second.position);
+    entries_.erase(it);
+  }
+
+  mutable std::mutex mutex_;
+  size_t capacity_;
+  size_t (*size_of_)(const T &);
+  // Most recently used first.
+  std::list<std::string> lru_;
+  std::unordered_map<std::string, Entry> entries_;
+  uint64_t generation_ = 0;
+  CacheStats stats_;
+};
+
+#endif // GRAPHICS_TINY_READER_LRU_CACHE_H_
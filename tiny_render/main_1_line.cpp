@@ -40,16 +40,18 @@ void DrawLine(int x0, int y0, int x1, int y1, TGAImage &image, TGAColor color) {
 
 int main(int argc, char **argv) {
   std::unique_ptr<Model> model;
+  // Only positions are drawn, so uvs, normals and the texture are skipped.
   if (2 == argc) {
-    model = std::make_unique<Model>(argv[1]);
+    model = std::make_unique<Model>(argv[1], 0, ModelLoadFlags::kGeometry);
   } else {
-    model = std::make_unique<Model>("obj/african_head.obj");
+    model = std::make_unique<Model>("obj/african_head.obj", 0,
+                                    ModelLoadFlags::kGeometry);
   }
   constexpr const int width = 800;
   constexpr const int height = 800;
   TGAImage image(width, height, TGAImage::RGB);
   for (int i = 0; i < model->nfaces(); i++) {
-    std::vector<size_t> face = model->face(i);
+    std::array<size_t, 3> face = model->face(i);
     for (int j = 0; j < 3; j++) {
       Vec3f v0 = model->vert(face[j]);
       Vec3f v1 = model->vert(face[(j + 1) % 3]);
@@ -61,8 +63,9 @@ int main(int argc, char **argv) {
     }
   }
 
-  // Set the origin at the left bottom corner of the image.
-  image.FlipVertically();
+  // Rows were drawn from the bottom up; the file records that instead of
+  // the rows being flipped.
+  image.DeclareRowOrder(TGAImage::RowOrder::kBottomUp);
   image.WriteTgaFile("output.tga");
   return 0;
 }
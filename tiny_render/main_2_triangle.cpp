@@ -5,6 +5,7 @@
 #include <memory>
 
 #include "model.h"
+#include "profiler.h"
 
 void DrawTriangle(Vec2i t0, Vec2i t1, Vec2i t2, TGAImage &image,
                   const TGAColor &color) {
@@ -84,10 +85,12 @@ void DrawTriangle(std::array<Vec2i, 3> pts, TGAImage &image,
 
 int main(int argc, char **argv) {
   std::unique_ptr<Model> model;
+  // Only positions are drawn, so uvs, normals and the texture are skipped.
   if (2 == argc) {
-    model = std::make_unique<Model>(argv[1]);
+    model = std::make_unique<Model>(argv[1], 0, ModelLoadFlags::kGeometry);
   } else {
-    model = std::make_unique<Model>("obj/african_head.obj");
+    model = std::make_unique<Model>("obj/african_head.obj", 0,
+                                    ModelLoadFlags::kGeometry);
   }
 
   constexpr const int width = 800;
@@ -97,26 +100,38 @@ int main(int argc, char **argv) {
   Vec3f light_dir(0, 0, -1); // define light_dir
 
   for (int i = 0; i < model->nfaces(); i++) {
-    std::vector<size_t> face = model->face(i);
+    PROFILE_COUNT(kTrianglesSubmitted, 1);
+    std::array<size_t, 3> face = model->face(i);
     Vec2i screen_coords[3];
     Vec3f world_coords[3];
-    for (int j = 0; j < 3; j++) {
-      Vec3f v = model->vert(face[j]);
-      screen_coords[j] = Vec2i(static_cast<int>((v.x + 1.) * width / 2.),
-                               static_cast<int>((v.y + 1.) * height / 2.));
-      world_coords[j] = v;
+    {
+      PROFILE_SCOPE(kTransform);
+      for (int j = 0; j < 3; j++) {
+        Vec3f v = model->vert(face[j]);
+        screen_coords[j] = Vec2i(static_cast<int>((v.x + 1.) * width / 2.),
+                                 static_cast<int>((v.y + 1.) * height / 2.));
+        world_coords[j] = v;
+      }
     }
-    Vec3f n = (world_coords[2] - world_coords[0]) ^
-              (world_coords[1] - world_coords[0]);
-    n.Normalize();
-    float intensity = n * light_dir;
+    float intensity;
+    {
+      PROFILE_SCOPE(kCull);
+      Vec3f n = (world_coords[2] - world_coords[0]) ^
+                (world_coords[1] - world_coords[0]);
+      n.Normalize();
+      intensity = n * light_dir;
+    }
+    PROFILE_COUNT(kTrianglesCulled, intensity <= 0);
     if (intensity > 0) {
+      PROFILE_SCOPE(kRaster);
       const auto intensity_v = static_cast<unsigned char>(intensity * 255);
       DrawTriangle(screen_coords[0], screen_coords[1], screen_coords[2], image,
                    TGAColor(intensity_v, intensity_v, intensity_v, 255));
     }
   }
-  image.FlipVertically();
+  image.DeclareRowOrder(TGAImage::RowOrder::kBottomUp);
   image.WriteTgaFile("output.tga");
+
+  PROFILE_END_FRAME("profile.json");
   return 0;
 }
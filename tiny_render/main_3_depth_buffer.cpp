@@ -1,114 +1,76 @@
+#include "depth_buffer.h"
 #include "geometry.h"
 #include "model.h"
+#include "profiler.h"
+#include "rasterizer.h"
 #include "tga_image.h"
-#include <cmath>
-#include <cstdlib>
+#include <array>
 #include <iostream>
-#include <limits>
 #include <memory>
-#include <vector>
 
 namespace {
 constexpr const int kWidth = 800;
 constexpr const int kHeight = 800;
 } // namespace
 
-Vec3f GetBarycentric(Vec3f A, Vec3f B, Vec3f C, Vec3f P) {
-  Vec3f s[2];
-  for (int i = 2; i--;) {
-    s[i][0] = C[i] - A[i];
-    s[i][1] = B[i] - A[i];
-    s[i][2] = A[i] - P[i];
-  }
-  Vec3f u = cross(s[0], s[1]);
-  if (std::abs(u[2]) > 1e-2) {
-    return Vec3f(1.f - (u.x + u.y) / u.z, u.y / u.z, u.x / u.z);
-  }
-  return Vec3f(-1, 1, 1);
-}
-
-void DrawTriangle(const Vec3f *pts,
-                  std::array<float, kWidth * kHeight> &zbuffer, TGAImage &image,
-                  const TGAColor &color, const TGAImage *texture,
-                  const Vec2i *uv) {
-  Vec2f bboxmin(std::numeric_limits<float>::max(),
-                std::numeric_limits<float>::max());
-  Vec2f bboxmax(-std::numeric_limits<float>::max(),
-                -std::numeric_limits<float>::max());
-  Vec2f clamp(image.width() - 1, image.height() - 1);
-  for (int i = 0; i < 3; i++) {
-    for (int j = 0; j < 2; j++) {
-      bboxmin[j] = std::max(0.f, std::min(bboxmin[j], pts[i][j]));
-      bboxmax[j] = std::min(clamp[j], std::max(bboxmax[j], pts[i][j]));
-    }
-  }
-  Vec3f P;
-  for (P.x = bboxmin.x; P.x <= bboxmax.x; P.x++) {
-    for (P.y = bboxmin.y; P.y <= bboxmax.y; P.y++) {
-      Vec3f barycentric_weight = GetBarycentric(pts[0], pts[1], pts[2], P);
-      if (barycentric_weight.x < 0 || barycentric_weight.y < 0 ||
-          barycentric_weight.z < 0) {
-        continue;
-      }
-      P.z = 0;
-      Vec2i pixel_uv;
-      for (int i = 0; i < 3; i++) {
-        P.z += pts[i][2] * barycentric_weight[i];
-        pixel_uv += uv[i] * barycentric_weight[i];
-      }
-      TGAColor texture_color = texture->Get(pixel_uv[0], pixel_uv[1]);
-      if (zbuffer[int(P.x + P.y * kWidth)] < P.z) {
-        zbuffer[int(P.x + P.y * kWidth)] = P.z;
-        image.Set(P.x, P.y, texture_color);
-      }
-    }
-  }
-}
-
+// Orthographic view of [-1, 1]^3, with z mapped to the renderer's [0,
+// kDepth] so that every depth format can hold it.
 Vec3f WorldToScreen(Vec3f v) {
   return Vec3f(int((v.x + 1.) * kWidth / 2. + .5),
-               int((v.y + 1.) * kHeight / 2. + .5), v.z);
+               int((v.y + 1.) * kHeight / 2. + .5),
+               (v.z + 1.f) * kDepth / 2.f);
 }
 
+// Usage: main_3 [model.obj [depth_format]], where depth_format is float (the
+// default), unorm16, unorm24 or reversed.
 int main(int argc, char **argv) {
   std::unique_ptr<Model> model;
-  if (2 == argc) {
+  if (argc >= 2) {
     model = std::make_unique<Model>(argv[1]);
   } else {
     model = std::make_unique<Model>("../obj/african_head.obj");
   }
-  std::unique_ptr<TGAImage> texture_image = std::make_unique<TGAImage>();
-  if (!texture_image->ReadTgaFile("../obj/african_head_diffuse.tga")) {
-    std::cerr << "Failed to read tga file." << std::endl;
+  DepthFormat format = DepthFormat::kFloat32;
+  if (argc >= 3 && !ParseDepthFormat(argv[2], format)) {
+    std::cerr << "unknown depth format " << argv[2] << std::endl;
+    return 1;
   }
-  texture_image->FlipVertically();
+  const TGAImage &texture_image = model->diffuse_map();
 
-  std::array<float, kWidth * kHeight> zbuffer;
-  std::fill(zbuffer.begin(), zbuffer.end(), -std::numeric_limits<float>::max());
-
-  Vec3f light_dir(0, 0, -1); // define light_dir
+  DepthBuffer depth(kWidth, kHeight, format);
   TGAImage image(kWidth, kHeight, TGAImage::RGB);
-  for (int i = 0; i < model->nfaces(); i++) {
-    std::vector<size_t> face = model->face(i);
-    Vec3f screen_coords[3];
-    Vec3f world_coords[3];
-    Vec2i uv[3];
-    for (int j = 0; j < 3; j++) {
-      world_coords[j] = model->vert(face[j]);
-      screen_coords[j] = WorldToScreen(world_coords[j]);
-      uv[j] = model->uv(i, j);
+  const TileRect clip{0, 0, kWidth, kHeight};
+  PROFILE_OVERDRAW_MAP(kWidth, kHeight);
+  // The loop is compiled once per depth format.
+  VisitDepthFormat(format, [&](auto depth_format) {
+    using Format = decltype(depth_format);
+    for (size_t i = 0; i < model->nfaces(); i++) {
+      PROFILE_COUNT(kTrianglesSubmitted, 1);
+      std::array<size_t, 3> face = model->face(i);
+      Vec3f screen_coords[3];
+      Vec2i uv[3];
+      {
+        PROFILE_SCOPE(kTransform);
+        for (int j = 0; j < 3; j++) {
+          screen_coords[j] = WorldToScreen(model->vert(face[j]));
+          uv[j] = model->uv(i, j);
+        }
+      }
+      // Unlit: every face is drawn with its texture as is.
+      PROFILE_SCOPE(kRaster);
+      RasterizeTriangle<Format>(
+          screen_coords[0], screen_coords[1], screen_coords[2], uv[0], uv[1],
+          uv[2], clip, depth, [&](int x, int y, const Vec2i &pixel_uv) {
+            PROFILE_COUNT(kTextureFetches, 1);
+            image.Set(x, y, texture_image.Get(pixel_uv.x, pixel_uv.y));
+          });
     }
+  });
 
-    Vec3f n = (world_coords[2] - world_coords[0]) ^
-              (world_coords[1] - world_coords[0]);
-    n.Normalize();
-    float intensity = n * light_dir;
-    const auto intensity_v = static_cast<unsigned char>(intensity * 255);
-    const auto color = TGAColor(intensity_v, intensity_v, intensity_v, 255);
-    DrawTriangle(screen_coords, zbuffer, image, color, texture_image.get(), uv);
-  }
-
-  image.FlipVertically();
+  image.DeclareRowOrder(TGAImage::RowOrder::kBottomUp);
   image.WriteTgaFile("output.tga");
+
+  PROFILE_END_FRAME("profile.json");
+  PROFILE_WRITE_OVERDRAW("overdraw.tga");
   return 0;
-}
\ No newline at end of file
+}
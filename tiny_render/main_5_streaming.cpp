@@ -0,0 +1,71 @@
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "obj_stream.h"
+#include "profiler.h"
+#include "rasterizer.h"
+#include "tga_image.h"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+constexpr const int kWidth = 800;
+constexpr const int kHeight = 800;
+} // namespace
+
+// Same scene as main_4, but the mesh is never loaded as a whole: triangles
+// are rasterized batch by batch while the rest of the file is still being
+// parsed. Usage: main_5_streaming [model.obj [vertex_window]]
+int main(int argc, char **argv) {
+  const std::string filename = argc >= 2 ? argv[1] : "../obj/african_head.obj";
+  ObjStreamOptions options;
+  if (argc >= 3) {
+    options.vertex_window = std::strtoul(argv[2], nullptr, 10);
+  }
+  ObjStream stream(filename.c_str(), options);
+
+  TGAImage texture;
+  const size_t dot = filename.find_last_of(".");
+  if (dot != std::string::npos) {
+    const std::string texfile = filename.substr(0, dot) + "_diffuse.tga";
+    std::cout << "Texture file " << texfile << " loading "
+              << (texture.MapTgaFile(texfile.c_str()) ? "ok" : "failed")
+              << std::endl;
+    texture.SetRowOrder(TGAImage::RowOrder::kBottomUp);
+  }
+
+  DepthBuffer depth(kWidth, kHeight);
+  const Vec3f light_dir(0, 0, -1);
+  const Vec3f camera(0, 0, 3);
+  const Matrix transform = PerspectiveTransform(kWidth, kHeight, camera.z);
+
+  TGAImage image(kWidth, kHeight, TGAImage::RGB);
+  PROFILE_OVERDRAW_MAP(kWidth, kHeight);
+  std::vector<StreamTriangle> batch;
+  while (stream.Next(batch)) {
+    for (const StreamTriangle &triangle : batch) {
+      Vec2i uv[3];
+      for (int j = 0; j < 3; j++) {
+        uv[j] = Vec2i(triangle.uv[j].x * texture.width(),
+                      triangle.uv[j].y * texture.height());
+      }
+      DrawFace(transform, light_dir, triangle.verts, uv, texture,
+               depth, image);
+    }
+  }
+  if (!stream.ok()) {
+    return 1;
+  }
+  if (stream.dropped_faces()) {
+    std::cerr << stream.dropped_faces()
+              << " faces referenced vertices outside the window\n";
+  }
+
+  image.DeclareRowOrder(TGAImage::RowOrder::kBottomUp);
+  image.WriteTgaFile("output.tga");
+
+  PROFILE_END_FRAME("profile.json");
+  PROFILE_WRITE_OVERDRAW("overdraw.tga");
+  return 0;
+}
@@ -0,0 +1,57 @@
+#include "gbuffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "profiler.h"
+#include "rasterizer.h"
+#include "tga_image.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+
+namespace {
+constexpr const int kWidth = 800;
+constexpr const int kHeight = 800;
+
+double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+} // namespace
+
+// Same scene as main_4, rasterized once into a G-buffer and then relit with
+// a few different lights. Usage: main_6_deferred [model.obj]
+int main(int argc, char **argv) {
+  const Model model(argc >= 2 ? argv[1] : "../obj/african_head.obj");
+  const Vec3f camera(0, 0, 3);
+  const Matrix transform = PerspectiveTransform(kWidth, kHeight, camera.z);
+
+  PROFILE_OVERDRAW_MAP(kWidth, kHeight);
+  auto start = std::chrono::steady_clock::now();
+  GBuffer gbuffer(kWidth, kHeight);
+  gbuffer.Draw(model, transform);
+  std::cout << "Geometry pass " << MillisecondsSince(start) << " ms"
+            << std::endl;
+
+  // Each setup is a key light and a fill light.
+  const Light setups[][2] = {
+      {{Vec3f(0, 0, -1), 1.f}, {Vec3f(0, 0, -1), 0.f}},
+      {{Vec3f(1, 0, -1).Normalize(), 1.f}, {Vec3f(0, 0, -1), 0.f}},
+      {{Vec3f(-1, 1, -1).Normalize(), 0.8f}, {Vec3f(0, 0, -1), 0.3f}},
+      {{Vec3f(0, -1, -1).Normalize(), 0.7f},
+       {Vec3f(1, 1, -1).Normalize(), 0.5f}},
+  };
+  TGAImage image(kWidth, kHeight, TGAImage::RGB);
+  for (size_t i = 0; i < std::size(setups); i++) {
+    start = std::chrono::steady_clock::now();
+    gbuffer.Shade(setups[i], image);
+    std::cout << "Lighting pass " << i << " " << MillisecondsSince(start)
+              << " ms" << std::endl;
+    image.DeclareRowOrder(TGAImage::RowOrder::kBottomUp);
+    image.WriteTgaFile(("relit_" + std::to_string(i) + ".tga").c_str());
+  }
+
+  PROFILE_END_FRAME("profile.json");
+  PROFILE_WRITE_OVERDRAW("overdraw.tga");
+  return 0;
+}
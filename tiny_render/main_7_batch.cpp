@@ -0,0 +1,51 @@
+#include "asset_cache.h"
+#include "batch_renderer.h"
+#include "task_scheduler.h"
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace {
+void PrintStats(const char *name, const CacheStats &stats) {
+  std::cout << name << " cache hits " << stats.hits << " misses "
+            << stats.misses << " evictions " << stats.evictions << " entries "
+            << stats.entries << " bytes " << stats.bytes << std::endl;
+}
+} // namespace
+
+// Long-running batch mode: reads render jobs (see ParseRenderJob) from a
+// manifest file, or from stdin when it is "-" or missing, and renders them
+// as tasks on a work-stealing scheduler with shared model and texture caches.
+// Usage: main_7_batch [manifest|- [threads]]
+int main(int argc, char **argv) {
+  std::ifstream file;
+  const bool use_stdin = argc < 2 || std::string(argv[1]) == "-";
+  if (!use_stdin) {
+    file.open(argv[1]);
+    if (file.fail()) {
+      std::cerr << "can't open manifest " << argv[1] << std::endl;
+      return 1;
+    }
+  }
+  std::istream &in = use_stdin ? std::cin : file;
+  // 0 is one thread per core.
+  TaskScheduler scheduler(argc >= 3 ? std::atoi(argv[2]) : 0);
+
+  AssetCache cache;
+  size_t failed;
+  {
+    BatchRenderer renderer(cache, scheduler, std::cout);
+    std::string line;
+    RenderJob job;
+    while (std::getline(in, line)) {
+      if (ParseRenderJob(line, job))
+        renderer.Submit(job);
+    }
+    failed = renderer.Finish();
+  }
+  PrintStats("Model", cache.model_stats());
+  PrintStats("Texture", cache.texture_stats());
+  PrintStats("Mesh", cache.mesh_stats());
+  return failed ? 1 : 0;
+}
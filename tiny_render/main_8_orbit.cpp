@@ -0,0 +1,95 @@
+#include "depth_buffer.h"
+#include "frame_sink.h"
+#include "frame_writer.h"
+#include "framebuffer_pool.h"
+#include "geometry.h"
+#include "model.h"
+#include "profiler.h"
+#include "rasterizer.h"
+#include "task_scheduler.h"
+#include "tga_image.h"
+#include "tiled_renderer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unistd.h>
+
+namespace {
+constexpr const int kWidth = 800;
+constexpr const int kHeight = 800;
+constexpr const float kPi = 3.14159265f;
+
+std::unique_ptr<FrameSink> MakeSink(const std::string &output) {
+  if (output == "-") {
+    // Frames take over stdout, so everything logged there goes to stderr. A
+    // reader that exits early fails the writes instead of killing us.
+    signal(SIGPIPE, SIG_IGN);
+    const int fd = dup(STDOUT_FILENO);
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    return std::make_unique<RawFdSink>(fd);
+  }
+  if (output.rfind("shm:", 0) == 0) {
+    auto sink = std::make_unique<SharedMemoryRingSink>(
+        output.substr(4), kWidth, kHeight, TGAImage::RGB);
+    return sink->ok() ? std::move(sink) : nullptr;
+  }
+  return std::make_unique<TgaFileSink>(output);
+}
+} // namespace
+
+// Turntable of the main_4 scene: the camera circles the model at main_4's
+// distance with the light at the camera. Frames are drawn by the tiled
+// renderer and written, up to queued_frames behind the one being drawn, as
+// tasks on one scheduler of threads threads (0, the default, is one per core).
+// Usage: main_8_orbit [model.obj [frames [queued_frames [threads
+//                     [output]]]]]
+// output is a printf pattern for TGA files (orbit_%03d.tga by default), "-"
+// for raw bgr24 frames on stdout, or shm:/name for a shared-memory ring.
+int main(int argc, char **argv) {
+  const std::unique_ptr<FrameSink> sink =
+      MakeSink(argc >= 6 ? argv[5] : "orbit_%03d.tga");
+  if (!sink) {
+    std::cerr << "Cannot open output " << argv[5] << std::endl;
+    return 1;
+  }
+  Model model(argc >= 2 ? argv[1] : "../obj/african_head.obj");
+  const VertexCacheStats cache = model.OptimizeVertexCache();
+  std::cout << "Vertex cache ACMR " << cache.acmr_before << " -> "
+            << cache.acmr_after << std::endl;
+  const int frames = argc >= 3 ? std::atoi(argv[2]) : 36;
+  const int queued_frames = argc >= 4 ? std::atoi(argv[3]) : 1;
+  TaskScheduler scheduler(argc >= 5 ? std::atoi(argv[4]) : 0);
+
+  const auto start = std::chrono::steady_clock::now();
+  FramebufferPool pool;
+  AsyncFrameWriter writer(pool, *sink, scheduler,
+                         static_cast<size_t>(std::max(queued_frames, 1)));
+  DepthBuffer depth(kWidth, kHeight);
+  TiledRenderer renderer;
+  const Vec3f center(0, 0, 0);
+  for (int frame = 0; frame < frames; frame++) {
+    const float angle = 2.f * kPi * frame / std::max(frames, 1);
+    const Vec3f eye(3.f * std::sin(angle), 0, 3.f * std::cos(angle));
+    Vec3f light_dir = center - eye;
+    light_dir.Normalize();
+    const Matrix transform = PerspectiveTransform(kWidth, kHeight, eye, center);
+
+    depth.Clear();
+    TGAImage image = pool.Acquire(kWidth, kHeight, TGAImage::RGB);
+    renderer.Draw(scheduler, model, transform, light_dir, depth, image);
+    writer.Submit(std::move(image));
+    PROFILE_END_FRAME("profile.json");
+  }
+  const size_t failed = writer.Finish();
+  std::cout << "Orbit " << frames << " frames in "
+            << std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count()
+            << " ms, " << failed << " failed writes" << std::endl;
+  return failed ? 1 : 0;
+}
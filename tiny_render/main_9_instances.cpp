@@ -0,0 +1,64 @@
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "instanced_scene.h"
+#include "model.h"
+#include "profiler.h"
+#include "rasterizer.h"
+#include "tga_image.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+
+namespace {
+constexpr const int kWidth = 800;
+constexpr const int kHeight = 800;
+} // namespace
+
+// A field of instances of one model: a side x side grid on the y = 0 plane,
+// each copy turned a little from its neighbours, seen from above one edge.
+// Only the copies inside the view are drawn.
+// Usage: main_9_instances [model.obj [side]]
+int main(int argc, char **argv) {
+  auto model = std::make_shared<Model>(argc >= 2 ? argv[1]
+                                                 : "../obj/african_head.obj");
+  const VertexCacheStats cache = model->OptimizeVertexCache();
+  std::cout << "Vertex cache ACMR " << cache.acmr_before << " -> "
+            << cache.acmr_after << std::endl;
+  const int side = argc >= 3 ? std::atoi(argv[2]) : 20;
+
+  InstancedScene scene;
+  const InstancedScene::ModelId id = scene.AddModel(model);
+  const float spacing = 0.5f;
+  const float half = (side - 1) * spacing / 2;
+  for (int i = 0; i < side; i++) {
+    for (int j = 0; j < side; j++) {
+      const Vec3f position(i * spacing - half, 0, j * spacing - half);
+      scene.AddInstance(id, PlaceObject(position, 0.3f * (i + 2 * j), 0.2f));
+    }
+  }
+
+  const Vec3f eye(0, 1.5f, 3.f);
+  const Vec3f center(0, 0, 0);
+  Vec3f light_dir = center - eye;
+  light_dir.Normalize();
+  DepthBuffer depth(kWidth, kHeight);
+  TGAImage image(kWidth, kHeight, TGAImage::RGB);
+  PROFILE_OVERDRAW_MAP(kWidth, kHeight);
+  const auto start = std::chrono::steady_clock::now();
+  const SceneStats stats =
+      DrawScene(scene, PerspectiveTransform(kWidth, kHeight, eye, center),
+                light_dir, depth, image);
+  std::cout << "Instances " << stats.instances << " frustum culled "
+            << stats.frustum_culled << " batches " << stats.batches << " in "
+            << std::chrono::duration<double, std::milli>(
+                   std::chrono::steady_clock::now() - start)
+                   .count()
+            << " ms" << std::endl;
+
+  image.DeclareRowOrder(TGAImage::RowOrder::kBottomUp);
+  image.WriteTgaFile("output.tga");
+  PROFILE_END_FRAME("profile.json");
+  PROFILE_WRITE_OVERDRAW("overdraw.tga");
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+
+float AverageCacheMissRatio(std::span<const Vec3i> corners, int cache_size) {
+  const size_t ntriangles = corners.size() / 3;
+  if (!ntriangles)
+    return 0.f;
+  std::vector<int> fifo(cache_size, -1);
+  size_t head = 0;
+  size_t misses = 0;
+  for (const Vec3i &corner : corners) {
+    if (std::find(fifo.begin(), fifo.end(), corner.ivert) != fifo.end())
+      continue;
+    misses++;
+    fifo[head] = corner.ivert;
+    head = (head + 1) % cache_size;
+  }
+  return static_cast<float>(misses) / ntriangles;
+}
+
+std::vector<size_t> TipsifyTriangleOrder(std::span<const Vec3i> corners,
+                                         size_t nverts, int cache_size) {
+  const size_t ntriangles = corners.size() / 3;
+  // Vertex -> triangles adjacency in compressed rows.
+  const auto valid = [&](int v) {
+    return v >= 0 && static_cast<size_t>(v) < nverts;
+  };
+  std::vector<int> live(nverts, 0);
+  for (const Vec3i &corner : corners) {
+    if (valid(corner.ivert))
+      live[corner.ivert]++;
+  }
+  std::vector<size_t> adjacency_start(nverts + 1, 0);
+  for (size_t v = 0; v < nverts; v++)
+    adjacency_start[v + 1] = adjacency_start[v] + live[v];
+  std::vector<size_t> adjacency(adjacency_start.back());
+  std::vector<size_t> fill(adjacency_start.begin(), adjacency_start.end() - 1);
+  for (size_t i = 0; i < corners.size(); i++) {
+    if (valid(corners[i].ivert))
+      adjacency[fill[corners[i].ivert]++] = i / 3;
+  }
+
+  std::vector<size_t> order;
+  order.reserve(ntriangles);
+  std::vector<char> emitted(ntriangles, 0);
+  std::vector<int> cache_time(nverts, 0);
+  std::vector<int> dead_end;
+  std::vector<int> candidates;
+  int timestamp = cache_size + 1;
+  size_t cursor = 1;
+  int fanning = nverts ? 0 : -1;
+  while (fanning >= 0) {
+    candidates.clear();
+    for (size_t a = adjacency_start[fanning]; a < adjacency_start[fanning + 1];
+         a++) {
+      const size_t t = adjacency[a];
+      if (emitted[t])
+        continue;
+      for (int k = 0; k < 3; k++) {
+        const int v = corners[t * 3 + k].ivert;
+        if (!valid(v))
+          continue;
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (timestamp - cache_time[v] > cache_size) {
+          cache_time[v] = timestamp++;
+        }
+      }
+      emitted[t] = 1;
+      order.push_back(t);
+    }
+
+    // Next fanning vertex: the candidate that will still be in the cache
+    // after its remaining triangles are emitted, oldest first.
+    int next = -1;
+    int best = -1;
+    for (int v : candidates) {
+      if (live[v] <= 0)
+        continue;
+      int priority = 0;
+      if (timestamp - cache_time[v] + 2 * live[v] <= cache_size)
+        priority = timestamp - cache_time[v];
+      if (priority > best) {
+        best = priority;
+        next = v;
+      }
+    }
+    if (next < 0) {
+      while (!dead_end.empty() && next < 0) {
+        const int v = dead_end.back();
+        dead_end.pop_back();
+        if (live[v] > 0)
+          next = v;
+      }
+      while (next < 0 && cursor < nverts) {
+        if (live[cursor] > 0)
+          next = static_cast<int>(cursor);
+        cursor++;
+      }
+    }
+    fanning = next;
+  }
+  // Triangles without a valid vertex never get fanned; keep them at the end.
+  for (size_t t = 0; t < ntriangles; t++) {
+    if (!emitted[t])
+      order.push_back(t);
+  }
+  return order;
+}
+
+std::vector<int> FirstUseRemap(std::span<const Vec3i> corners, int which,
+                               size_t count) {
+  std::vector<int> remap(count, -1);
+  int next = 0;
+  for (const Vec3i &corner : corners) {
+    const int idx = corner[which];
+    if (idx >= 0 && static_cast<size_t>(idx) < count && remap[idx] < 0)
+      remap[idx] = next++;
+  }
+  for (int &idx : remap) {
+    if (idx < 0)
+      idx = next++;
+  }
+  return remap;
+}
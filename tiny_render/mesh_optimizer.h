@@ -0,0 +1,33 @@
+#ifndef GRAPHICS_TINY_READER_MESH_OPTIMIZER_H_
+#define GRAPHICS_TINY_READER_MESH_OPTIMIZER_H_
+
+#include <span>
+#include <vector>
+
+#include "geometry.h"
+
+// Index-buffer optimizations on triangle corner lists, three (vertex, uv,
+// normal) corners per triangle as stored by Model. Only the vertex index of
+// each corner takes part in the cache model.
+
+constexpr int kVertexCacheSize = 16;
+
+// Average number of vertices transformed per triangle (ACMR) when drawing the
+// triangles in order through a FIFO post-transform cache of cache_size
+// entries. 3 is the worst case, about 0.5 the best a closed mesh can do.
+float AverageCacheMissRatio(std::span<const Vec3i> corners,
+                            int cache_size = kVertexCacheSize);
+
+// Triangle order from Tipsify (Sander, Nehab and Barczak, "Fast Triangle
+// Reordering for Vertex Locality and Reduced Overdraw", 2007): fans around
+// recently used vertices, preferring ones still in the cache.
+std::vector<size_t> TipsifyTriangleOrder(std::span<const Vec3i> corners,
+                                         size_t nverts,
+                                         int cache_size = kVertexCacheSize);
+
+// Maps every element index to its rank of first use by component `which` of
+// the corners (0 vertex, 1 uv, 2 normal); unused elements go last.
+std::vector<int> FirstUseRemap(std::span<const Vec3i> corners, int which,
+                               size_t count);
+
+#endif // GRAPHICS_TINY_READER_MESH_OPTIMIZER_H_
@@ -0,0 +1,286 @@
+#include "mesh_simplifier.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <queue>
+#include <unordered_map>
+
+#include "mesh_optimizer.h"
+
+namespace {
+// Symmetric 4x4 plane quadric, upper triangle only.
+struct Quadric {
+  double q[10] = {};
+
+  static Quadric FromPlane(double a, double b, double c, double d) {
+    const double plane[4] = {a, b, c, d};
+    Quadric p;
+    int n = 0;
+    for (int i = 0; i < 4; i++) {
+      for (int j = i; j < 4; j++)
+        p.q[n++] = plane[i] * plane[j];
+    }
+    return p;
+  }
+
+  Quadric &operator+=(const Quadric &o) {
+    for (int i = 0; i < 10; i++)
+      q[i] += o.q[i];
+    return *this;
+  }
+
+  double Error(const Vec3f &v) const {
+    const double x = v.x, y = v.y, z = v.z;
+    return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x +
+           q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y + q[7] * z * z +
+           2 * q[8] * z + q[9];
+  }
+};
+
+struct Collapse {
+  double cost;
+  int from;
+  int to;
+  // Versions of both endpoints when the entry was queued; a mismatch means
+  // the neighbourhood changed and the entry is stale.
+  unsigned from_version;
+  unsigned to_version;
+
+  bool operator>(const Collapse &o) const { return cost > o.cost; }
+};
+
+uint64_t EdgeKey(int a, int b) {
+  if (a > b)
+    std::swap(a, b);
+  return (static_cast<uint64_t>(a) << 32) | static_cast<uint32_t>(b);
+}
+
+Vec3f FaceNormal(const Vec3f &a, const Vec3f &b, const Vec3f &c) {
+  return (b - a) ^ (c - a);
+}
+
+// Keeps the elements of data referenced by component `which` of corners,
+// renumbering the corners to match.
+template <typename T>
+std::vector<T> CompactAttribute(std::vector<Vec3i> &corners, int which,
+                                std::span<const T> data) {
+  const std::vector<int> remap = FirstUseRemap(corners, which, data.size());
+  size_t used = 0;
+  for (Vec3i &corner : corners) {
+    if (corner[which] < 0 || static_cast<size_t>(corner[which]) >= data.size())
+      continue;
+    corner[which] = remap[corner[which]];
+    used = std::max<size_t>(used, corner[which] + 1);
+  }
+  std::vector<T> compact(used);
+  for (size_t i = 0; i < data.size(); i++) {
+    if (static_cast<size_t>(remap[i]) < used)
+      compact[remap[i]] = data[i];
+  }
+  return compact;
+}
+} // namespace
+
+std::unique_ptr<Model> SimplifyModel(const Model &model, size_t target_faces) {
+  const std::span<const Vec3f> verts = model.verts();
+  const int nverts = static_cast<int>(verts.size());
+  std::vector<Vec3i> corners(model.corners().begin(), model.corners().end());
+  const size_t nfaces = corners.size() / 3;
+  const auto valid = [&](int v) { return v >= 0 && v < nverts; };
+
+  std::vector<char> face_alive(nfaces, 1);
+  size_t alive_faces = nfaces;
+  std::vector<std::vector<int>> vertex_faces(nverts);
+  std::vector<int> vertex_uv(nverts, -1);
+  std::vector<char> locked(nverts, 0);
+  std::vector<Quadric> quadrics(nverts);
+  std::unordered_map<uint64_t, int> edge_use;
+  for (size_t f = 0; f < nfaces; f++) {
+    const Vec3i *c = &corners[f * 3];
+    if (!valid(c[0].ivert) || !valid(c[1].ivert) || !valid(c[2].ivert)) {
+      face_alive[f] = 0;
+      alive_faces--;
+      continue;
+    }
+    Vec3f n = FaceNormal(verts[c[0].ivert], verts[c[1].ivert],
+                         verts[c[2].ivert]);
+    if (n.Norm() > 0)
+      n.Normalize();
+    const Quadric plane =
+        Quadric::FromPlane(n.x, n.y, n.z, -(n * verts[c[0].ivert]));
+    for (int k = 0; k < 3; k++) {
+      const int v = c[k].ivert;
+      // A vertex with two different uvs sits on a texture seam.
+      if (vertex_faces[v].empty())
+        vertex_uv[v] = c[k].iuv;
+      else if (vertex_uv[v] != c[k].iuv)
+        locked[v] = 1;
+      vertex_faces[v].push_back(static_cast<int>(f));
+      quadrics[v] += plane;
+      edge_use[EdgeKey(v, c[(k + 1) % 3].ivert)]++;
+    }
+  }
+  for (const auto &[key, uses] : edge_use) {
+    if (uses == 1) {
+      locked[key >> 32] = 1;
+      locked[key & 0xffffffff] = 1;
+    }
+  }
+
+  std::vector<unsigned> version(nverts, 0);
+  std::vector<char> vertex_alive(nverts, 1);
+  std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>>
+      heap;
+  const auto push = [&](int from, int to) {
+    if (locked[from])
+      return;
+    Quadric q = quadrics[from];
+    q += quadrics[to];
+    heap.push({q.Error(verts[to]), from, to, version[from], version[to]});
+  };
+  const auto push_around = [&](int v) {
+    for (int f : vertex_faces[v]) {
+      if (!face_alive[f])
+        continue;
+      for (int k = 0; k < 3; k++) {
+        const int w = corners[f * 3 + k].ivert;
+        if (w != v) {
+          push(v, w);
+          push(w, v);
+        }
+      }
+    }
+  };
+  for (int v = 0; v < nverts; v++)
+    push_around(v);
+
+  while (alive_faces > target_faces && !heap.empty()) {
+    const Collapse c = heap.top();
+    heap.pop();
+    const int u = c.from;
+    const int v = c.to;
+    if (!vertex_alive[u] || !vertex_alive[v] || c.from_version != version[u] ||
+        c.to_version != version[v])
+      continue;
+
+    // Reject the collapse if a surviving triangle around u would flip or
+    // degenerate once u moves onto v.
+    bool flips = false;
+    for (int f : vertex_faces[u]) {
+      if (!face_alive[f])
+        continue;
+      Vec3f before[3], after[3];
+      bool has_v = false;
+      for (int k = 0; k < 3; k++) {
+        const int w = corners[f * 3 + k].ivert;
+        has_v |= w == v;
+        before[k] = verts[w];
+        after[k] = verts[w == u ? v : w];
+      }
+      if (has_v)
+        continue;
+      const Vec3f n0 = FaceNormal(before[0], before[1], before[2]);
+      const Vec3f n1 = FaceNormal(after[0], after[1], after[2]);
+      if (n1.Norm() < 1e-12f || n0 * n1 < 0.2f * n0.Norm() * n1.Norm()) {
+        flips = true;
+        break;
+      }
+    }
+    if (flips)
+      continue;
+
+    // u's corners take v's uv and normal from the faces around the edge,
+    // which lie on u's side of any seam through v. v's first uv could
+    // belong to the chart on the other side.
+    Vec3i target(v, -1, -1);
+    bool found = false, agree = true;
+    for (int f : vertex_faces[u]) {
+      if (!face_alive[f])
+        continue;
+      for (int k = 0; k < 3; k++) {
+        const Vec3i &corner = corners[f * 3 + k];
+        if (corner.ivert != v)
+          continue;
+        if (found && (corner.iuv != target.iuv ||
+                      corner.inorm != target.inorm))
+          agree = false;
+        target = corner;
+        found = true;
+      }
+    }
+    if (!found || !agree)
+      continue;
+
+    for (int f : vertex_faces[u]) {
+      if (!face_alive[f])
+        continue;
+      Vec3i *face = &corners[f * 3];
+      if (face[0].ivert == v || face[1].ivert == v || face[2].ivert == v) {
+        face_alive[f] = 0;
+        alive_faces--;
+        continue;
+      }
+      for (int k = 0; k < 3; k++) {
+        if (face[k].ivert == u)
+          face[k] = target;
+      }
+      vertex_faces[v].push_back(f);
+    }
+    quadrics[v] += quadrics[u];
+    vertex_alive[u] = 0;
+    vertex_faces[u].clear();
+    version[v]++;
+    push_around(v);
+  }
+
+  std::vector<Vec3i> kept;
+  kept.reserve(alive_faces * 3);
+  for (size_t f = 0; f < nfaces; f++) {
+    if (face_alive[f])
+      kept.insert(kept.end(), &corners[f * 3], &corners[f * 3] + 3);
+  }
+  const std::vector<Vec3f> new_verts = CompactAttribute(kept, 0, verts);
+  const std::vector<Vec2f> new_uvs = CompactAttribute(kept, 1, model.uvs());
+  const std::vector<Vec3f> new_norms =
+      CompactAttribute(kept, 2, model.norms());
+  return std::make_unique<Model>(new_verts, new_uvs, new_norms, kept,
+                                 model.shared_diffuse_map());
+}
+
+LodChain::LodChain(std::shared_ptr<const Model> base, float ratio,
+                   size_t min_faces) {
+  levels_.push_back(std::move(base));
+  while (levels_.back()->nfaces() > min_faces) {
+    const size_t faces = levels_.back()->nfaces();
+    const size_t target =
+        std::max(min_faces, static_cast<size_t>(faces * ratio));
+    std::shared_ptr<const Model> next = SimplifyModel(*levels_.back(), target);
+    // Seams and boundaries can make further reduction impossible.
+    if (next->nfaces() >= faces * 0.95f)
+      break;
+    levels_.push_back(std::move(next));
+  }
+}
+
+size_t LodChain::SelectLevel(const Matrix &transform,
+                             float pixels_per_triangle) const {
+  const Model &base = *levels_.front();
+  const Vec3f center = (base.bbox_min() + base.bbox_max()) * 0.5f;
+  const float radius = (base.bbox_max() - base.bbox_min()).Norm() * 0.5f;
+  const Vec3f c = transform.TransformPoint(center);
+  float screen_radius = 0.f;
+  for (int axis = 0; axis < 3; axis++) {
+    Vec3f offset(0, 0, 0);
+    offset[axis] = radius;
+    const Vec3f p = transform.TransformPoint(center + offset);
+    screen_radius = std::max(screen_radius, std::hypot(p.x - c.x, p.y - c.y));
+  }
+  const float budget =
+      3.14159265f * screen_radius * screen_radius / pixels_per_triangle;
+  for (size_t i = levels_.size(); i-- > 1;) {
+    if (levels_[i]->nfaces() >= budget)
+      return i;
+  }
+  return 0;
+}
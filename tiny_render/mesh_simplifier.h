@@ -0,0 +1,44 @@
+#ifndef GRAPHICS_TINY_READER_MESH_SIMPLIFIER_H_
+#define GRAPHICS_TINY_READER_MESH_SIMPLIFIER_H_
+
+#include <memory>
+#include <vector>
+
+#include "geometry.h"
+#include "model.h"
+
+// Quadric error simplification (Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics", 1997) by half-edge collapse:
+// a vertex is merged into a neighbour, so surviving vertices keep their
+// position, uv and normal. Vertices on a uv seam or on an open boundary are
+// never removed, which keeps texture seams and silhouettes intact, and
+// collapses that would flip a triangle are rejected. Returns a model with at
+// most target_faces triangles when the mesh allows it, sharing the texture.
+std::unique_ptr<Model> SimplifyModel(const Model &model, size_t target_faces);
+
+// A model and successively simplified copies of it, finest first.
+class LodChain {
+public:
+  // Each level has about ratio times the triangles of the previous one; the
+  // chain stops at min_faces or when the simplifier can make no progress.
+  explicit LodChain(std::shared_ptr<const Model> base, float ratio = 0.5f,
+                    size_t min_faces = 128);
+
+  size_t nlevels() const { return levels_.size(); }
+  const Model &level(size_t i) const { return *levels_[i]; }
+
+  // The coarsest level that still has one triangle per pixels_per_triangle
+  // pixels of the model's bounding sphere, as projected by transform (a
+  // viewport * projection matrix).
+  size_t SelectLevel(const Matrix &transform,
+                     float pixels_per_triangle = 4.f) const;
+  const Model &Select(const Matrix &transform,
+                      float pixels_per_triangle = 4.f) const {
+    return level(SelectLevel(transform, pixels_per_triangle));
+  }
+
+private:
+  std::vector<std::shared_ptr<const Model>> levels_;
+};
+
+#endif // GRAPHICS_TINY_READER_MESH_SIMPLIFIER_H_
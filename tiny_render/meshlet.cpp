@@ -0,0 +1,288 @@
+#include "meshlet.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "profiler.h"
+#include "rasterizer.h"
+
+namespace {
+Vec3f UnitFaceNormal(const Model &model, size_t face) {
+  const std::array<size_t, 3> f = model.face(face);
+  Vec3f n = (model.vert(f[2]) - model.vert(f[0])) ^
+            (model.vert(f[1]) - model.vert(f[0]));
+  const float length = n.Norm();
+  return length > 0 ? n * (1.f / length) : n;
+}
+
+// Fills in the sphere and cone of a meshlet whose face range is set.
+void ComputeBounds(const Model &model, Meshlet &m) {
+  Vec3f lo(std::numeric_limits<float>::max(),
+           std::numeric_limits<float>::max(),
+           std::numeric_limits<float>::max());
+  Vec3f hi = lo * -1.f;
+  Vec3f axis(0, 0, 0);
+  for (size_t f = m.first_face; f < m.first_face + m.nfaces; f++) {
+    for (size_t v : model.face(f)) {
+      for (int i = 0; i < 3; i++) {
+        lo[i] = std::min(lo[i], model.vert(v)[i]);
+        hi[i] = std::max(hi[i], model.vert(v)[i]);
+      }
+    }
+    axis = axis + UnitFaceNormal(model, f);
+  }
+  m.center = (lo + hi) * 0.5f;
+  m.radius = 0.f;
+  for (size_t f = m.first_face; f < m.first_face + m.nfaces; f++) {
+    for (size_t v : model.face(f))
+      m.radius = std::max(m.radius, (model.vert(v) - m.center).Norm());
+  }
+  m.cone_axis = axis.Norm() > 0 ? axis.Normalize() : Vec3f(0, 0, 1);
+  m.cone_cutoff = 1.f;
+  for (size_t f = m.first_face; f < m.first_face + m.nfaces; f++) {
+    const Vec3f n = UnitFaceNormal(model, f);
+    // Degenerate faces have no direction; DrawFace never draws them.
+    if (n.Norm() > 0)
+      m.cone_cutoff = std::min(m.cone_cutoff, n * m.cone_axis);
+  }
+}
+} // namespace
+
+std::vector<Meshlet> BuildMeshlets(Model &model, size_t max_verts,
+                                   size_t max_faces) {
+  const size_t nfaces = model.nfaces();
+  std::vector<Vec3f> normals(nfaces);
+  std::vector<size_t> adjacency_start(model.nverts() + 1, 0);
+  for (size_t f = 0; f < nfaces; f++) {
+    normals[f] = UnitFaceNormal(model, f);
+    for (size_t v : model.face(f))
+      adjacency_start[v + 1]++;
+  }
+  for (size_t v = 0; v < model.nverts(); v++)
+    adjacency_start[v + 1] += adjacency_start[v];
+  std::vector<size_t> adjacency(adjacency_start.back());
+  std::vector<size_t> fill(adjacency_start.begin(), adjacency_start.end() - 1);
+  for (size_t f = 0; f < nfaces; f++) {
+    for (size_t v : model.face(f))
+      adjacency[fill[v]++] = f;
+  }
+
+  std::vector<char> assigned(nfaces, 0);
+  std::vector<size_t> order;
+  order.reserve(nfaces);
+  std::vector<size_t> ranges;
+  std::vector<size_t> verts;
+  std::vector<size_t> candidates;
+  // Entries equal to the current meshlet's stamp mark its vertices and the
+  // faces already in candidates; starting a meshlet clears both at once.
+  std::vector<size_t> vert_stamp(model.nverts(), 0);
+  std::vector<size_t> candidate_stamp(nfaces, 0);
+  size_t stamp = 0;
+  const auto new_verts = [&](size_t f) {
+    size_t added = 0;
+    for (size_t v : model.face(f))
+      added += vert_stamp[v] != stamp;
+    return added;
+  };
+  for (size_t seed = 0; seed < nfaces; seed++) {
+    if (assigned[seed])
+      continue;
+    ranges.push_back(order.size());
+    stamp = ranges.size();
+    verts.clear();
+    candidates.clear();
+    Vec3f normal_sum(0, 0, 0);
+    size_t face = seed;
+    size_t count = 0;
+    while (true) {
+      assigned[face] = 1;
+      order.push_back(face);
+      normal_sum = normal_sum + normals[face];
+      for (size_t v : model.face(face)) {
+        if (vert_stamp[v] == stamp)
+          continue;
+        vert_stamp[v] = stamp;
+        verts.push_back(v);
+        for (size_t a = adjacency_start[v]; a < adjacency_start[v + 1]; a++) {
+          const size_t f = adjacency[a];
+          if (assigned[f] || candidate_stamp[f] == stamp)
+            continue;
+          candidate_stamp[f] = stamp;
+          candidates.push_back(f);
+        }
+      }
+      if (++count == max_faces)
+        break;
+      const Vec3f axis =
+          normal_sum.Norm() > 0 ? normal_sum * (1.f / normal_sum.Norm())
+                                : normal_sum;
+      float best_score = std::numeric_limits<float>::max();
+      size_t best = nfaces;
+      // Assigned faces are dropped as they are found, keeping the order.
+      size_t kept = 0;
+      for (size_t c : candidates) {
+        if (assigned[c])
+          continue;
+        candidates[kept++] = c;
+        const size_t added = new_verts(c);
+        if (verts.size() + added > max_verts)
+          continue;
+        const float score = added + 2.f * (1.f - normals[c] * axis);
+        if (score < best_score) {
+          best_score = score;
+          best = c;
+        }
+      }
+      candidates.resize(kept);
+      if (best == nfaces)
+        break;
+      face = best;
+    }
+  }
+  model.ReorderFaces(order);
+
+  std::vector<Meshlet> meshlets(ranges.size());
+  for (size_t i = 0; i < ranges.size(); i++) {
+    const size_t end = i + 1 < ranges.size() ? ranges[i + 1] : nfaces;
+    meshlets[i].first_face = static_cast<uint32_t>(ranges[i]);
+    meshlets[i].nfaces = static_cast<uint32_t>(end - ranges[i]);
+    ComputeBounds(model, meshlets[i]);
+  }
+  return meshlets;
+}
+
+bool ConeCulled(const Meshlet &meshlet, const Vec3f &dir) {
+  if (meshlet.cone_cutoff <= 0.f)
+    return false;
+  // The normal closest to dir is at angle(axis, dir) - acos(cutoff); all
+  // faces are culled if even that one is at least 90 degrees from dir.
+  const float sine = std::sqrt(1.f - meshlet.cone_cutoff * meshlet.cone_cutoff);
+  return meshlet.cone_axis * dir <= -sine * dir.Norm();
+}
+
+bool ProjectBounds(const Meshlet &meshlet, const Matrix &transform,
+                   ScreenBounds &bounds) {
+  float x0 = std::numeric_limits<float>::max();
+  float y0 = x0;
+  float x1 = -x0;
+  float y1 = -x0;
+  float max_z = -x0;
+  for (int corner = 0; corner < 8; corner++) {
+    const Vec3f offset(corner & 1 ? meshlet.radius : -meshlet.radius,
+                       corner & 2 ? meshlet.radius : -meshlet.radius,
+                       corner & 4 ? meshlet.radius : -meshlet.radius);
+    float w;
+    const Vec3f p = transform.TransformPoint(meshlet.center + offset, &w);
+    if (w <= 0.f)
+      return false;
+    x0 = std::min(x0, p.x);
+    y0 = std::min(y0, p.y);
+    x1 = std::max(x1, p.x);
+    y1 = std::max(y1, p.y);
+    max_z = std::max(max_z, p.z);
+  }
+  // The rasterizer rounds to whole pixels and depth steps.
+  bounds.x0 = static_cast<int>(std::floor(x0)) - 1;
+  bounds.y0 = static_cast<int>(std::floor(y0)) - 1;
+  bounds.x1 = static_cast<int>(std::ceil(x1)) + 1;
+  bounds.y1 = static_cast<int>(std::ceil(y1)) + 1;
+  bounds.max_z = max_z + 1.f;
+  return true;
+}
+
+void DepthTiles::Build(const DepthBuffer &depth) {
+  const int width = depth.width();
+  const int height = depth.height();
+  width_ = width;
+  height_ = height;
+  tiles_x_ = (width + kTileSize - 1) / kTileSize;
+  const int tiles_y = (height + kTileSize - 1) / kTileSize;
+  tiles_.assign(static_cast<size_t>(tiles_x_) * tiles_y,
+                std::numeric_limits<float>::max());
+  for (int y = 0; y < height; y++) {
+    float *row = &tiles_[(y / kTileSize) * tiles_x_];
+    for (int x = 0; x < width; x++) {
+      float &tile = row[x / kTileSize];
+      tile = std::min(tile, depth.Get(x, y));
+    }
+  }
+}
+
+bool DepthTiles::Occluded(const ScreenBounds &bounds) const {
+  const int x0 = std::max(bounds.x0, 0);
+  const int y0 = std::max(bounds.y0, 0);
+  const int x1 = std::min(bounds.x1, width_ - 1);
+  const int y1 = std::min(bounds.y1, height_ - 1);
+  if (tiles_.empty() || x0 > x1 || y0 > y1)
+    return false;
+  for (int ty = y0 / kTileSize; ty <= y1 / kTileSize; ty++) {
+    for (int tx = x0 / kTileSize; tx <= x1 / kTileSize; tx++) {
+      if (tiles_[tx + ty * tiles_x_] < bounds.max_z)
+        return false;
+    }
+  }
+  return true;
+}
+
+MeshletStats DrawMeshlets(const Model &model, std::span<const Meshlet> meshlets,
+                          const Matrix &transform, const Vec3f &light_dir,
+                          DepthBuffer &depth, TGAImage &image,
+                          int occlusion_passes) {
+  MeshletStats stats;
+  struct Visible {
+    const Meshlet *meshlet;
+    ScreenBounds bounds;
+  };
+  std::vector<Visible> visible;
+  visible.reserve(meshlets.size());
+  for (const Meshlet &m : meshlets) {
+    stats.submitted++;
+    PROFILE_COUNT(kClustersSubmitted, 1);
+    if (ConeCulled(m, light_dir)) {
+      stats.cone_culled++;
+      continue;
+    }
+    ScreenBounds bounds;
+    if (!ProjectBounds(m, transform, bounds)) {
+      // Crosses the camera plane: always drawn, never tested for occlusion.
+      bounds = ScreenBounds{0, 0, -1, -1, std::numeric_limits<float>::max()};
+    } else if (bounds.x1 < 0 || bounds.y1 < 0 || bounds.x0 >= image.width() ||
+               bounds.y0 >= image.height()) {
+      stats.frustum_culled++;
+      continue;
+    }
+    visible.push_back({&m, bounds});
+  }
+  std::stable_sort(visible.begin(), visible.end(),
+                   [](const Visible &a, const Visible &b) {
+                     return a.bounds.max_z > b.bounds.max_z;
+                   });
+
+  DepthTiles tiles;
+  const size_t group =
+      (visible.size() + occlusion_passes - 1) / std::max(occlusion_passes, 1);
+  for (size_t i = 0; i < visible.size(); i++) {
+    if (group && i && i % group == 0)
+      tiles.Build(depth);
+    if (tiles.Occluded(visible[i].bounds)) {
+      stats.occluded++;
+      continue;
+    }
+    const Meshlet &m = *visible[i].meshlet;
+    for (size_t f = m.first_face; f < m.first_face + m.nfaces; f++) {
+      const std::array<size_t, 3> face = model.face(f);
+      Vec3f world_coords[3];
+      Vec2i uv[3];
+      for (int j = 0; j < 3; j++) {
+        world_coords[j] = model.vert(face[j]);
+        uv[j] = model.uv(f, j);
+      }
+      DrawFace(transform, light_dir, world_coords, uv, model.diffuse_map(),
+               depth, image);
+    }
+  }
+  PROFILE_COUNT(kClustersCulled,
+                stats.cone_culled + stats.frustum_culled + stats.occluded);
+  return stats;
+}
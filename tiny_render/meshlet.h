@@ -0,0 +1,86 @@
+#ifndef GRAPHICS_TINY_READER_MESHLET_H_
+#define GRAPHICS_TINY_READER_MESHLET_H_
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "tga_image.h"
+
+// A run of consecutive faces of a Model with bounds that let the whole run be
+// rejected before any per-triangle work.
+struct Meshlet {
+  uint32_t first_face;
+  uint32_t nfaces;
+  // Object-space bounding sphere.
+  Vec3f center;
+  float radius;
+  // Every face normal (v2 - v0) ^ (v1 - v0), normalized, is within the cone
+  // around cone_axis whose half angle has cosine cone_cutoff. A cutoff <= 0
+  // means the normals spread too far for the cone to reject anything.
+  Vec3f cone_axis;
+  float cone_cutoff;
+};
+
+// Groups the faces into clusters of at most max_faces triangles touching at
+// most max_verts distinct vertices, and reorders the faces of model so each
+// cluster is a consecutive run. Clusters grow from a seed face through shared
+// vertices, preferring faces that add few vertices and whose normal is close
+// to the cluster's, so that the normal cones stay narrow. Seeds are taken in
+// the current face order, so run Model::OptimizeVertexCache first.
+std::vector<Meshlet> BuildMeshlets(Model &model, size_t max_verts = 64,
+                                   size_t max_faces = 124);
+
+// True if every face of the meshlet has n * dir <= 0, i.e. DrawFace would
+// cull each of them for a light along dir.
+bool ConeCulled(const Meshlet &meshlet, const Vec3f &dir);
+
+// Screen rectangle and nearest depth covered by a meshlet's bounding sphere.
+struct ScreenBounds {
+  int x0, y0, x1, y1;
+  float max_z;
+};
+
+// Projects the cube around the bounding sphere. Returns false if the cube
+// reaches behind the camera, where the rectangle would not be conservative.
+bool ProjectBounds(const Meshlet &meshlet, const Matrix &transform,
+                   ScreenBounds &bounds);
+
+// Farthest depth of each kTileSize x kTileSize block of a z-buffer, for
+// conservative occlusion tests of screen rectangles.
+class DepthTiles {
+public:
+  static constexpr int kTileSize = 8;
+
+  void Build(const DepthBuffer &depth);
+  // True if nothing at or in front of bounds.max_z can pass the depth test
+  // anywhere in the rectangle.
+  bool Occluded(const ScreenBounds &bounds) const;
+
+private:
+  std::vector<float> tiles_;
+  int width_ = 0;
+  int height_ = 0;
+  int tiles_x_ = 0;
+};
+
+struct MeshletStats {
+  size_t submitted = 0;
+  size_t cone_culled = 0;
+  size_t frustum_culled = 0;
+  size_t occluded = 0;
+};
+
+// Draws the meshlets like DrawFace draws faces, rejecting whole meshlets by
+// cone and screen bounds first. Survivors are drawn nearest first in
+// occlusion_passes groups; before each group after the first the depth tiles
+// are rebuilt and meshlets hidden behind what is already drawn are skipped.
+MeshletStats DrawMeshlets(const Model &model, std::span<const Meshlet> meshlets,
+                          const Matrix &transform, const Vec3f &light_dir,
+                          DepthBuffer &depth, TGAImage &image,
+                          int occlusion_passes = 4);
+
+#endif // GRAPHICS_TINY_READER_MESHLET_H_
@@ -1,80 +1,254 @@
 #include "model.h"
+#include "asset_cache.h"
+#include "carve.h"
+#include "obj_parser.h"
+#include "profiler.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
-#include <sstream>
+#include <iterator>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
-Model::Model(const char *filename) : verts_(), faces_() {
+namespace {
+// Runs fn(0) .. fn(n - 1), each on its own thread.
+template <typename Fn> void ParallelFor(size_t n, Fn fn) {
+  std::vector<std::thread> threads;
+  threads.reserve(n ? n - 1 : 0);
+  for (size_t i = 1; i < n; i++)
+    threads.emplace_back(fn, i);
+  if (n)
+    fn(0);
+  for (std::thread &thread : threads)
+    thread.join();
+}
+
+// Moves element i of data to position remap[i].
+template <typename T>
+void Permute(std::span<T> data, const std::vector<int> &remap) {
+  const std::vector<T> original(data.begin(), data.end());
+  for (size_t i = 0; i < original.size(); i++)
+    data[remap[i]] = original[i];
+}
+} // namespace
+
+Model::Model(const char *filename, int load_threads, ModelLoadFlags load,
+             size_t min_chunk_bytes)
+    : Model(filename, nullptr, load_threads, load, min_chunk_bytes) {
+  if (!storage_)
+    return;
+  diffuse_path_ = TexturePath(filename, "_diffuse.tga");
+  if (HasFlag(load, ModelLoadFlags::kDiffuse))
+    shared_diffuse_map();
+}
+
+Model::Model(const char *filename, std::shared_ptr<const TGAImage> diffuse_map,
+             int load_threads, ModelLoadFlags load,
+             size_t min_chunk_bytes)
+    : diffuse_map_(std::move(diffuse_map)) {
+  PROFILE_SCOPE(kLoad);
   std::ifstream in;
-  in.open(filename, std::ifstream::in);
+  in.open(filename, std::ifstream::in | std::ifstream::binary);
   if (in.fail())
     return;
-  std::string line;
-  while (!in.eof()) {
-    std::getline(in, line);
-    std::istringstream iss(line.c_str());
-    char trash;
-    if (!line.compare(0, 2, "v ")) {
-      iss >> trash;
-      Vec3f v;
-      for (int i = 0; i < 3; i++)
-        iss >> v.raw[i];
-      verts_.push_back(v);
-    } else if (!line.compare(0, 2, "f ")) {
-      std::vector<Vec3i> f;
-      Vec3i tmp;
-      iss >> trash;
-      while (iss >> tmp[0] >> trash >> tmp[1] >> trash >> tmp[2]) {
-        // in wavefront obj all indices start at 1, not zero
-        for (int i = 0; i < 3; ++i) {
-          tmp[i]--;
-        }
-        f.push_back(tmp);
-      }
-      faces_.push_back(f);
-    } else if (!line.compare(0, 3, "vt ")) {
-      iss >> trash >> trash;
-      Vec2f uv;
-      iss >> uv[0] >> uv[1];
-      uv_.push_back(uv);
+  const std::string buffer((std::istreambuf_iterator<char>(in)),
+                           std::istreambuf_iterator<char>());
+  const char *begin = buffer.data();
+  const char *end = begin + buffer.size();
+
+  // Chunks end on line boundaries, so each one can be counted and parsed on
+  // its own thread. The prefix sums of the per-chunk counts give every chunk
+  // its write offsets and the number of records before it, which is what
+  // relative indices resolve against; the result matches a serial parse.
+  if (load_threads <= 0)
+    load_threads = std::max(1u, std::thread::hardware_concurrency());
+  const size_t max_chunks =
+      buffer.size() / std::max<size_t>(min_chunk_bytes, 1) + 1;
+  const auto chunks = SplitAtLines(
+      begin, end, std::min<size_t>(load_threads, max_chunks));
+  std::vector<ObjCounts> offsets(chunks.size());
+  ParallelFor(chunks.size(), [&](size_t i) {
+    offsets[i] = CountRecords(chunks[i].first, chunks[i].second);
+  });
+  ObjCounts total;
+  for (ObjCounts &chunk : offsets) {
+    const ObjCounts counts = chunk;
+    chunk = total;
+    total.verts += counts.verts;
+    total.uvs += counts.uvs;
+    total.norms += counts.norms;
+    total.faces += counts.faces;
+  }
+  Allocate(total.verts, HasFlag(load, ModelLoadFlags::kUvs) ? total.uvs : 0,
+           HasFlag(load, ModelLoadFlags::kNormals) ? total.norms : 0,
+           total.faces);
+  ParallelFor(chunks.size(), [&](size_t i) {
+    Parse(chunks[i].first, chunks[i].second, offsets[i], load);
+  });
+  ComputeBounds();
+  std::cout << "Loaded # v# " << nverts() << " f# " << nfaces() << " vt# "
+            << uv_.size() << std::endl;
+}
+
+Model::Model(std::span<const Vec3f> verts, std::span<const Vec2f> uvs,
+             std::span<const Vec3f> norms, std::span<const Vec3i> corners,
+             std::shared_ptr<const TGAImage> diffuse_map)
+    : diffuse_map_(std::move(diffuse_map)) {
+  Allocate(verts.size(), uvs.size(), norms.size(), corners.size() / 3);
+  std::copy(verts.begin(), verts.end(), verts_.begin());
+  std::copy(uvs.begin(), uvs.end(), uv_.begin());
+  std::copy(norms.begin(), norms.end(), norms_.begin());
+  std::copy(corners.begin(), corners.begin() + faces_.size(), faces_.begin());
+  ComputeBounds();
+}
+
+void Model::ComputeBounds() {
+  if (verts_.empty()) {
+    bbox_min_ = bbox_max_ = Vec3f(0, 0, 0);
+    return;
+  }
+  bbox_min_ = bbox_max_ = verts_[0];
+  for (const Vec3f &v : verts_) {
+    for (int i = 0; i < 3; i++) {
+      bbox_min_[i] = std::min(bbox_min_[i], v[i]);
+      bbox_max_[i] = std::max(bbox_max_[i], v[i]);
     }
   }
-  std::cout << "Loaded # v# " << verts_.size() << " f# " << faces_.size()
-            << " vt# " << uv_.size() << std::endl;
+}
 
-  LoadTexture(filename, "_diffuse.tga", diffuse_map_);
+void Model::Parse(const char *begin, const char *end, ObjCounts seen,
+                  ModelLoadFlags load) {
+  const bool uvs = HasFlag(load, ModelLoadFlags::kUvs);
+  const bool norms = HasFlag(load, ModelLoadFlags::kNormals);
+  // Skipped records are still counted, since relative indices in later
+  // faces resolve against them.
+  const auto keep = [&](Vec3i corner) {
+    if (!uvs)
+      corner.iuv = -1;
+    if (!norms)
+      corner.inorm = -1;
+    return corner;
+  };
+  ForEachLine(begin, end, [&](const char *line, const char *eol) {
+    if (StartsWith(line, eol, "v ")) {
+      ParseFloats(line + 2, eol, verts_[seen.verts++].raw, 3);
+    } else if (StartsWith(line, eol, "vt ")) {
+      if (uvs)
+        ParseFloats(line + 3, eol, uv_[seen.uvs].raw, 2);
+      seen.uvs++;
+    } else if (StartsWith(line, eol, "vn ")) {
+      if (norms)
+        ParseFloats(line + 3, eol, norms_[seen.norms].raw, 3);
+      seen.norms++;
+    } else if (StartsWith(line, eol, "f ")) {
+      ForEachFaceTriangle(line, eol, seen,
+                          [&](const Vec3i &a, const Vec3i &b, const Vec3i &c) {
+                            faces_[seen.faces * 3] = keep(a);
+                            faces_[seen.faces * 3 + 1] = keep(b);
+                            faces_[seen.faces * 3 + 2] = keep(c);
+                            seen.faces++;
+                          });
+    }
+  });
+}
+
+void Model::Allocate(size_t nverts, size_t nuvs, size_t nnorms,
+                     size_t nfaces) {
+  storage_ = std::make_unique_for_overwrite<unsigned char[]>(
+      (nverts + nnorms) * sizeof(Vec3f) + nuvs * sizeof(Vec2f) +
+      nfaces * 3 * sizeof(Vec3i));
+  // Every mesh element type is 4-byte aligned, so no padding is needed.
+  static_assert(alignof(Vec3f) == 4 && alignof(Vec2f) == 4 &&
+                alignof(Vec3i) == 4);
+  unsigned char *p = storage_.get();
+  verts_ = Carve<Vec3f>(p, nverts);
+  uv_ = Carve<Vec2f>(p, nuvs);
+  norms_ = Carve<Vec3f>(p, nnorms);
+  faces_ = Carve<Vec3i>(p, nfaces * 3);
 }
 
-std::vector<size_t> Model::face(size_t idx) const {
-  std::vector<size_t> ans;
-  ans.reserve(faces_[idx].size());
-  for (size_t i = 0; i < faces_[idx].size(); ++i) {
-    ans.push_back(faces_[idx][i][0]);
+VertexCacheStats Model::OptimizeVertexCache(int cache_size) {
+  VertexCacheStats stats;
+  stats.acmr_before = AverageCacheMissRatio(faces_, cache_size);
+  ReorderFaces(TipsifyTriangleOrder(faces_, verts_.size(), cache_size));
+  std::vector<Vec3i> reordered(faces_.begin(), faces_.end());
+  const size_t counts[3] = {verts_.size(), uv_.size(), norms_.size()};
+  for (int which = 0; which < 3; which++) {
+    const std::vector<int> remap =
+        FirstUseRemap(reordered, which, counts[which]);
+    for (Vec3i &corner : reordered) {
+      const int idx = corner[which];
+      if (idx >= 0 && static_cast<size_t>(idx) < counts[which])
+        corner[which] = remap[idx];
+    }
+    if (which == 0)
+      Permute(verts_, remap);
+    else if (which == 1)
+      Permute(uv_, remap);
+    else
+      Permute(norms_, remap);
   }
-  return ans;
-}
-
-void Model::LoadTexture(std::string filename, const char *suffix,
-                        TGAImage &img) {
-  std::string texfile(filename);
-  size_t dot = texfile.find_last_of(".");
-  if (dot != std::string::npos) {
-    texfile = texfile.substr(0, dot) + std::string(suffix);
-    std::cout << "Texture file " << texfile << " loading "
-              << (img.ReadTgaFile(texfile.c_str()) ? "ok" : "failed")
-              << std::endl;
-    img.FlipVertically();
+  std::copy(reordered.begin(), reordered.end(), faces_.begin());
+  stats.acmr_after = AverageCacheMissRatio(faces_, cache_size);
+  return stats;
+}
+
+void Model::ReorderFaces(std::span<const size_t> order) {
+  const std::vector<Vec3i> original(faces_.begin(), faces_.end());
+  for (size_t t = 0; t < order.size(); t++) {
+    for (int k = 0; k < 3; k++)
+      faces_[t * 3 + k] = original[order[t] * 3 + k];
   }
 }
 
+std::array<size_t, 3> Model::face(size_t idx) const {
+  return {static_cast<size_t>(faces_[idx * 3][0]),
+          static_cast<size_t>(faces_[idx * 3 + 1][0]),
+          static_cast<size_t>(faces_[idx * 3 + 2][0])};
+}
+
+std::string Model::TexturePath(const std::string &filename,
+                               const char *suffix) {
+  const size_t dot = filename.find_last_of(".");
+  if (dot == std::string::npos)
+    return "";
+  return filename.substr(0, dot) + suffix;
+}
+
+const std::shared_ptr<const TGAImage> &Model::shared_diffuse_map() const {
+  std::call_once(diffuse_once_, [this] {
+    if (diffuse_map_)
+      return;
+    if (!diffuse_path_.empty()) {
+      diffuse_map_ = LoadSharedTexture(diffuse_path_);
+      std::cout << "Texture file " << diffuse_path_ << " loading "
+                << (diffuse_map_ ? "ok" : "failed") << std::endl;
+    }
+    if (!diffuse_map_)
+      diffuse_map_ = std::make_shared<TGAImage>();
+  });
+  return diffuse_map_;
+}
+
 TGAColor Model::Diffuse(const Vec2i &uv) const {
-  return diffuse_map_.Get(uv.x, uv.y);
+  PROFILE_COUNT(kTextureFetches, 1);
+  return diffuse_map().Get(uv.x, uv.y);
 }
 
 Vec2i Model::uv(size_t face_id, size_t vertex_id) const {
-  const int idx = faces_[face_id][vertex_id][1];
-  return Vec2i(uv_[idx].x * diffuse_map_.width(),
-               uv_[idx].y * diffuse_map_.height());
-}
\ No newline at end of file
+  const int idx = faces_[face_id * 3 + vertex_id][1];
+  if (idx < 0)
+    return Vec2i(0, 0);
+  const TGAImage &texture = diffuse_map();
+  return Vec2i(uv_[idx].x * texture.width(), uv_[idx].y * texture.height());
+}
+
+Vec3f Model::normal(size_t face_id, size_t vertex_id) const {
+  const int idx = faces_[face_id * 3 + vertex_id][2];
+  if (idx < 0)
+    return Vec3f(0, 0, 0);
+  return norms_[idx];
+}
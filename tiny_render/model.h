@@ -2,30 +2,130 @@
 #define GRAPHICS_TINY_READER_MODEL_H_
 
 #include "geometry.h"
+#include "mesh_optimizer.h"
 #include "tga_image.h"
+#include <array>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
 #include <vector>
 
+struct ObjCounts;
+
+// What the obj constructors load besides positions and faces. Without kUvs
+// or kNormals those records are skipped and the corners refer to none; the
+// diffuse texture is decoded on first use unless kDiffuse asks for it up
+// front.
+enum class ModelLoadFlags : unsigned {
+  kGeometry = 0,
+  kUvs = 1 << 0,
+  kNormals = 1 << 1,
+  kDiffuse = 1 << 2,
+  kDefault = kUvs | kNormals,
+  kAll = kUvs | kNormals | kDiffuse,
+};
+
+constexpr ModelLoadFlags operator|(ModelLoadFlags a, ModelLoadFlags b) {
+  return static_cast<ModelLoadFlags>(static_cast<unsigned>(a) |
+                                     static_cast<unsigned>(b));
+}
+
+constexpr bool HasFlag(ModelLoadFlags flags, ModelLoadFlags flag) {
+  return (static_cast<unsigned>(flags) & static_cast<unsigned>(flag)) != 0;
+}
+
+struct VertexCacheStats {
+  float acmr_before;
+  float acmr_after;
+};
+
+// Triangle mesh loaded from a wavefront obj file. Polygons are fan
+// triangulated on load. All mesh arrays live in one block that is sized by a
+// counting pass over the file, so a model costs a single allocation (plus its
+// texture) and is released in one step. Textures are shared by path with
+// every other model and AssetCache through LoadSharedTexture.
 class Model {
 public:
-  Model(const char *filename);
+  // Below this many bytes per chunk, thread startup outweighs the parsing.
+  static constexpr size_t kMinChunkBytes = 1 << 20;
 
-  std::vector<size_t> face(size_t idx) const;
+  // Large files are parsed on up to load_threads threads (0 means one per
+  // core), in chunks of at least min_chunk_bytes; the result does not depend
+  // on the thread count.
+  Model(const char *filename, int load_threads = 0,
+        ModelLoadFlags load = ModelLoadFlags::kDefault,
+        size_t min_chunk_bytes = kMinChunkBytes);
+  // Loads only the mesh and uses an already decoded diffuse texture.
+  Model(const char *filename, std::shared_ptr<const TGAImage> diffuse_map,
+        int load_threads = 0, ModelLoadFlags load = ModelLoadFlags::kDefault,
+        size_t min_chunk_bytes = kMinChunkBytes);
+  // Builds a model from mesh arrays laid out as corners() describes, sharing
+  // an already decoded texture.
+  Model(std::span<const Vec3f> verts, std::span<const Vec2f> uvs,
+        std::span<const Vec3f> norms, std::span<const Vec3i> corners,
+        std::shared_ptr<const TGAImage> diffuse_map);
+
+  std::array<size_t, 3> face(size_t idx) const;
   Vec2i uv(size_t face_id, size_t vertex_id) const;
+  Vec3f normal(size_t face_id, size_t vertex_id) const;
 
   size_t nverts() const { return verts_.size(); }
 
-  size_t nfaces() const { return faces_.size(); }
+  size_t nfaces() const { return faces_.size() / 3; }
+
+  Vec3f vert(size_t i) const { return verts_[i]; }
+
+  std::span<const Vec3f> verts() const { return verts_; }
+  std::span<const Vec2f> uvs() const { return uv_; }
+  std::span<const Vec3f> norms() const { return norms_; }
+  // Three (vertex, uv, normal) index triples per face; -1 marks a missing
+  // index.
+  std::span<const Vec3i> corners() const { return faces_; }
 
-  Vec3f vert(size_t i) { return verts_[i]; }
+  // Axis-aligned bounds of the vertices.
+  Vec3f bbox_min() const { return bbox_min_; }
+  Vec3f bbox_max() const { return bbox_max_; }
+
+  // Reorders the triangles for post-transform vertex cache reuse, then the
+  // vertices, uvs and normals by first use so the face loop walks the
+  // arrays nearly sequentially. Returns ACMR before and after.
+  VertexCacheStats OptimizeVertexCache(int cache_size = kVertexCacheSize);
+  // Puts face order[i] in position i.
+  void ReorderFaces(std::span<const size_t> order);
+
+  // The texture file that goes with an obj file: its path with the
+  // extension replaced by suffix, or "" if it has no extension.
+  static std::string TexturePath(const std::string &filename,
+                                 const char *suffix);
 
   TGAColor Diffuse(const Vec2i &uv) const;
+  // Decodes the texture on the first call from any thread; empty if the
+  // model has none.
+  const TGAImage &diffuse_map() const { return *shared_diffuse_map(); }
+  const std::shared_ptr<const TGAImage> &shared_diffuse_map() const;
 
 private:
-  void LoadTexture(std::string filename, const char *suffix, TGAImage &img);
-  std::vector<Vec3f> verts_;
-  std::vector<std::vector<Vec3i>> faces_;
-  std::vector<Vec2f> uv_;
-  TGAImage diffuse_map_;
+  // Carves the vertex, uv, normal and face-corner arrays out of one block.
+  void Allocate(size_t nverts, size_t nuvs, size_t nnorms, size_t nfaces);
+  // Parses the records in [begin, end) into the arrays, starting at the
+  // offsets in seen.
+  void Parse(const char *begin, const char *end, ObjCounts seen,
+             ModelLoadFlags load);
+  void ComputeBounds();
+
+  std::unique_ptr<unsigned char[]> storage_;
+  std::span<Vec3f> verts_;
+  std::span<Vec2f> uv_;
+  std::span<Vec3f> norms_;
+  // Three (vertex, uv, normal) corners per face; -1 marks a missing index.
+  std::span<Vec3i> faces_;
+  Vec3f bbox_min_;
+  Vec3f bbox_max_;
+  // Where diffuse_map_ comes from when it is first needed.
+  std::string diffuse_path_;
+  mutable std::once_flag diffuse_once_;
+  mutable std::shared_ptr<const TGAImage> diffuse_map_;
 };
 
 #endif // GRAPHICS_TINY_READER_MODEL_H_
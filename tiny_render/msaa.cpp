@@ -0,0 +1,193 @@
+#include "msaa.h"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#include "profiler.h"
+
+namespace {
+// Standard rotated and sparse grid positions in 1/16 pixel, relative to the
+// pixel centre; every row and column of the pixel holds one sample.
+constexpr float kPattern1[1][2] = {{0, 0}};
+constexpr float kPattern4[4][2] = {
+    {-2 / 16.f, -6 / 16.f}, {6 / 16.f, -2 / 16.f},
+    {-6 / 16.f, 2 / 16.f},  {2 / 16.f, 6 / 16.f}};
+constexpr float kPattern8[8][2] = {
+    {1 / 16.f, -3 / 16.f},  {-1 / 16.f, 3 / 16.f}, {5 / 16.f, 1 / 16.f},
+    {-3 / 16.f, -5 / 16.f}, {-5 / 16.f, 5 / 16.f}, {-7 / 16.f, -1 / 16.f},
+    {3 / 16.f, 7 / 16.f},   {7 / 16.f, -7 / 16.f}};
+
+float Edge(const Vec3f &a, const Vec3f &b, float x, float y) {
+  return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+}
+
+// Top-left fill rule for a counter-clockwise (positive area) triangle, so
+// samples exactly on an edge shared by two triangles are covered once.
+bool TopLeft(const Vec3f &a, const Vec3f &b) {
+  return (a.y == b.y && b.x < a.x) || b.y > a.y;
+}
+} // namespace
+
+MsaaTarget::MsaaTarget(int width, int height, int samples)
+    : width_(width), height_(height), samples_(samples) {
+  if (samples_ >= 8) {
+    samples_ = 8;
+    pattern_ = kPattern8;
+  } else if (samples_ >= 4) {
+    samples_ = 4;
+    pattern_ = kPattern4;
+  } else {
+    samples_ = 1;
+    pattern_ = kPattern1;
+  }
+  const size_t n = static_cast<size_t>(width_) * height_ * samples_;
+  color_.resize(n);
+  depth_.resize(n);
+  Clear();
+}
+
+Vec2f MsaaTarget::SampleOffset(int s) const {
+  return Vec2f(pattern_[s][0], pattern_[s][1]);
+}
+
+void MsaaTarget::Clear() {
+  std::fill(color_.begin(), color_.end(), 0u);
+  std::fill(depth_.begin(), depth_.end(), -std::numeric_limits<float>::max());
+}
+
+void MsaaTarget::DrawTriangle(const Vec3f pts[3], const Vec2f uv[3],
+                              const TGAImage &texture, float intensity) {
+  Vec3f p[3] = {pts[0], pts[1], pts[2]};
+  Vec2f t[3] = {uv[0], uv[1], uv[2]};
+  float area = Edge(p[0], p[1], p[2].x, p[2].y);
+  if (area == 0.f || !std::isfinite(area))
+    return;
+  if (area < 0.f) {
+    std::swap(p[1], p[2]);
+    std::swap(t[1], t[2]);
+    area = -area;
+  }
+  const bool top_left[3] = {TopLeft(p[1], p[2]), TopLeft(p[2], p[0]),
+                            TopLeft(p[0], p[1])};
+
+  // Samples lie within half a pixel of the centre, so pixels whose centre is
+  // further than that from the triangle's bounds cannot be covered.
+  const float lo_x = std::min({p[0].x, p[1].x, p[2].x});
+  const float hi_x = std::max({p[0].x, p[1].x, p[2].x});
+  const float lo_y = std::min({p[0].y, p[1].y, p[2].y});
+  const float hi_y = std::max({p[0].y, p[1].y, p[2].y});
+  const int x0 = std::max(0, static_cast<int>(std::floor(lo_x - 0.5f)));
+  const int x1 = std::min(width_ - 1, static_cast<int>(std::ceil(hi_x + 0.5f)));
+  const int y0 = std::max(0, static_cast<int>(std::floor(lo_y - 0.5f)));
+  const int y1 =
+      std::min(height_ - 1, static_cast<int>(std::ceil(hi_y + 0.5f)));
+
+  const float inv_area = 1.f / area;
+  for (int y = y0; y <= y1; y++) {
+    for (int x = x0; x <= x1; x++) {
+      const size_t base = (static_cast<size_t>(x) + y * width_) * samples_;
+      unsigned mask = 0;
+      float sum_w1 = 0.f;
+      float sum_w2 = 0.f;
+      for (int s = 0; s < samples_; s++) {
+        const float sx = x + pattern_[s][0];
+        const float sy = y + pattern_[s][1];
+        const float w[3] = {Edge(p[1], p[2], sx, sy), Edge(p[2], p[0], sx, sy),
+                            Edge(p[0], p[1], sx, sy)};
+        bool inside = true;
+        for (int e = 0; e < 3; e++)
+          inside &= w[e] > 0.f || (w[e] == 0.f && top_left[e]);
+        if (!inside)
+          continue;
+        const float z =
+            (w[0] * p[0].z + w[1] * p[1].z + w[2] * p[2].z) * inv_area;
+        if (depth_[base + s] < z) {
+          depth_[base + s] = z;
+          mask |= 1u << s;
+          sum_w1 += w[1];
+          sum_w2 += w[2];
+        }
+      }
+      PROFILE_COUNT(kPixelsTested, 1);
+      if (!mask)
+        continue;
+      PROFILE_COUNT(kPixelsPassed, 1);
+      PROFILE_FRAGMENT(x, y);
+
+      // One shade per pixel, at the centroid of the samples that passed, so
+      // the texture is never read from outside the triangle.
+      const float covered = static_cast<float>(std::popcount(mask));
+      const float b1 = sum_w1 * inv_area / covered;
+      const float b2 = sum_w2 * inv_area / covered;
+      const Vec2f uvp = t[0] + (t[1] - t[0]) * b1 + (t[2] - t[0]) * b2;
+      PROFILE_COUNT(kTextureFetches, 1);
+      const TGAColor texel = texture.Get(static_cast<int>(uvp.x),
+                                         static_cast<int>(uvp.y));
+      const TGAColor color(texel.r * intensity, texel.g * intensity,
+                           texel.b * intensity);
+      for (int s = 0; s < samples_; s++) {
+        if (mask & (1u << s))
+          color_[base + s] = color.val;
+      }
+    }
+  }
+}
+
+void MsaaTarget::Resolve(TGAImage &image) const {
+  for (int y = 0; y < height_; y++) {
+    for (int x = 0; x < width_; x++) {
+      const uint32_t *sample =
+          &color_[(static_cast<size_t>(x) + y * width_) * samples_];
+      unsigned sum[3] = {0, 0, 0};
+      for (int s = 0; s < samples_; s++) {
+        for (int c = 0; c < 3; c++)
+          sum[c] += (sample[s] >> (8 * c)) & 0xff;
+      }
+      const unsigned half = samples_ / 2;
+      image.Set(x, y,
+                TGAColor((sum[2] + half) / samples_, (sum[1] + half) / samples_,
+                         (sum[0] + half) / samples_));
+    }
+  }
+}
+
+void MsaaTarget::ResolveDepth(DepthBuffer &depth) const {
+  for (int y = 0; y < height_; y++) {
+    for (int x = 0; x < width_; x++) {
+      const float *sample =
+          &depth_[(static_cast<size_t>(x) + y * width_) * samples_];
+      depth.Set(x, y, *std::max_element(sample, sample + samples_));
+    }
+  }
+}
+
+bool DrawFaceMsaa(const Matrix &transform, const Vec3f &light_dir,
+                  const Vec3f world_coords[3], const Vec2i uv[3],
+                  const TGAImage &texture, MsaaTarget &target) {
+  PROFILE_COUNT(kTrianglesSubmitted, 1);
+  Vec3f screen_coords[3];
+  {
+    PROFILE_SCOPE(kTransform);
+    for (int j = 0; j < 3; j++)
+      screen_coords[j] = transform.TransformPoint(world_coords[j]);
+  }
+  float intensity;
+  {
+    PROFILE_SCOPE(kCull);
+    Vec3f n = (world_coords[2] - world_coords[0]) ^
+              (world_coords[1] - world_coords[0]);
+    n.Normalize();
+    intensity = n * light_dir;
+  }
+  if (!(intensity > 0)) {
+    PROFILE_COUNT(kTrianglesCulled, 1);
+    return false;
+  }
+  PROFILE_SCOPE(kRaster);
+  const Vec2f texels[3] = {Vec2f(uv[0].x, uv[0].y), Vec2f(uv[1].x, uv[1].y),
+                           Vec2f(uv[2].x, uv[2].y)};
+  target.DrawTriangle(screen_coords, texels, texture, intensity);
+  return true;
+}
@@ -0,0 +1,54 @@
+#ifndef GRAPHICS_TINY_READER_MSAA_H_
+#define GRAPHICS_TINY_READER_MSAA_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "tga_image.h"
+
+// Multisampled colour and depth target. Each pixel holds `samples` colour
+// and depth values at fixed sub-pixel positions; a triangle is shaded once
+// per pixel and the colour is stored in every sample it covers and passes
+// the depth test at. Resolve averages the samples into an ordinary image.
+class MsaaTarget {
+public:
+  // samples is 1, 4 or 8.
+  MsaaTarget(int width, int height, int samples);
+
+  int width() const { return width_; }
+  int height() const { return height_; }
+  int samples() const { return samples_; }
+
+  // Offset of sample s from the pixel centre, in pixels.
+  Vec2f SampleOffset(int s) const;
+
+  void Clear();
+
+  // Rasterizes a triangle given in screen space (x, y in pixels, larger z is
+  // nearer) with texel uvs, modulating the texture by intensity.
+  void DrawTriangle(const Vec3f pts[3], const Vec2f uv[3],
+                    const TGAImage &texture, float intensity);
+
+  // Averages the samples of each pixel into image (RGB, same size).
+  void Resolve(TGAImage &image) const;
+  // Nearest depth among the samples of each pixel.
+  void ResolveDepth(DepthBuffer &depth) const;
+
+private:
+  int width_;
+  int height_;
+  int samples_;
+  const float (*pattern_)[2];
+  std::vector<uint32_t> color_;
+  std::vector<float> depth_;
+};
+
+// DrawFace for a multisampled target: transforms and culls like DrawFace,
+// without rounding the vertices to whole pixels.
+bool DrawFaceMsaa(const Matrix &transform, const Vec3f &light_dir,
+                  const Vec3f world_coords[3], const Vec2i uv[3],
+                  const TGAImage &texture, MsaaTarget &target);
+
+#endif // GRAPHICS_TINY_READER_MSAA_H_
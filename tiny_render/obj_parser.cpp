@@ -0,0 +1,103 @@
+#include "obj_parser.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Turns a 1-based (or negative, relative to the elements read so far) obj
+// index into a 0-based one.
+int ResolveIndex(long idx, size_t count) {
+  return idx < 0 ? static_cast<int>(count + idx) : static_cast<int>(idx - 1);
+}
+} // namespace
+
+bool StartsWith(const char *line, const char *end, const char *prefix) {
+  const size_t n = strlen(prefix);
+  return static_cast<size_t>(end - line) >= n && !strncmp(line, prefix, n);
+}
+
+const char *SkipSpaces(const char *p, const char *end) {
+  while (p < end && IsSpace(*p))
+    p++;
+  return p;
+}
+
+int CountCorners(const char *line, const char *end) {
+  int corners = 0;
+  const char *p = line + 2;
+  while ((p = SkipSpaces(p, end)) < end) {
+    corners++;
+    while (p < end && !IsSpace(*p))
+      p++;
+  }
+  return corners;
+}
+
+void ParseFloats(const char *p, const char *end, float *out, int n) {
+  for (int i = 0; i < n; i++) {
+    char *next;
+    const float value = strtof(p, &next);
+    if (next == p || next > end)
+      return;
+    out[i] = value;
+    p = next;
+  }
+}
+
+ObjCounts CountRecords(const char *begin, const char *end) {
+  ObjCounts counts;
+  ForEachLine(begin, end, [&](const char *line, const char *eol) {
+    if (StartsWith(line, eol, "v ")) {
+      counts.verts++;
+    } else if (StartsWith(line, eol, "vt ")) {
+      counts.uvs++;
+    } else if (StartsWith(line, eol, "vn ")) {
+      counts.norms++;
+    } else if (StartsWith(line, eol, "f ")) {
+      const int corners = CountCorners(line, eol);
+      if (corners >= 3)
+        counts.faces += corners - 2;
+    }
+  });
+  return counts;
+}
+
+std::vector<std::pair<const char *, const char *>>
+SplitAtLines(const char *begin, const char *end, size_t n) {
+  std::vector<std::pair<const char *, const char *>> ranges;
+  const size_t step = (end - begin) / (n ? n : 1) + 1;
+  while (begin < end) {
+    const char *split = begin + std::min<size_t>(step, end - begin);
+    const char *eol =
+        static_cast<const char *>(memchr(split - 1, '\n', end - (split - 1)));
+    split = eol ? eol + 1 : end;
+    ranges.emplace_back(begin, split);
+    begin = split;
+  }
+  return ranges;
+}
+
+const char *ParseCorner(const char *p, const char *end, const ObjCounts &seen,
+                        Vec3i &corner) {
+  const size_t counts[3] = {seen.verts, seen.uvs, seen.norms};
+  corner = Vec3i(-1, -1, -1);
+  for (int i = 0; i < 3 && p < end; i++) {
+    if (*p != '/') {
+      char *next;
+      const long idx = strtol(p, &next, 10);
+      if (next == p)
+        break;
+      corner[i] = ResolveIndex(idx, counts[i]);
+      p = next;
+    }
+    if (p >= end || *p != '/')
+      break;
+    p++;
+  }
+  while (p < end && !IsSpace(*p))
+    p++;
+  return p;
+}
@@ -0,0 +1,81 @@
+#ifndef GRAPHICS_TINY_READER_OBJ_PARSER_H_
+#define GRAPHICS_TINY_READER_OBJ_PARSER_H_
+
+#include <cstddef>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "geometry.h"
+
+// Line-level helpers for wavefront obj text shared by the Model loader and
+// the streaming reader. Every function works on a [p, end) range of one
+// line, without the trailing newline.
+
+// Records of each kind seen so far; relative face indices resolve against it.
+struct ObjCounts {
+  size_t verts = 0;
+  size_t uvs = 0;
+  size_t norms = 0;
+  size_t faces = 0;
+};
+
+bool StartsWith(const char *line, const char *end, const char *prefix);
+
+const char *SkipSpaces(const char *p, const char *end);
+
+// Number of "v/vt/vn" groups on an "f " line.
+int CountCorners(const char *line, const char *end);
+
+// Reads up to n floats into out; stops early (leaving out untouched) at the
+// first token that is not a number.
+void ParseFloats(const char *p, const char *end, float *out, int n);
+
+// Parses one "v", "v/vt", "v//vn" or "v/vt/vn" group into 0-based indices;
+// missing indices are -1 and negative ones are resolved against seen.
+const char *ParseCorner(const char *p, const char *end, const ObjCounts &seen,
+                        Vec3i &corner);
+
+// Records of each kind in [begin, end), with faces counted as triangles.
+ObjCounts CountRecords(const char *begin, const char *end);
+
+// Splits [begin, end) into at most n non-empty ranges of similar size, each
+// ending right after a newline (or at end).
+std::vector<std::pair<const char *, const char *>>
+SplitAtLines(const char *begin, const char *end, size_t n);
+
+// Calls fn(begin, end) for every line of the buffer, without the newline.
+template <typename Fn>
+void ForEachLine(const char *begin, const char *end, Fn fn) {
+  while (begin < end) {
+    const char *eol =
+        static_cast<const char *>(memchr(begin, '\n', end - begin));
+    if (!eol)
+      eol = end;
+    fn(begin, eol);
+    begin = eol + 1;
+  }
+}
+
+// Calls fn(a, b, c) for each triangle of the fan triangulation of an "f "
+// line. Returns the number of triangles.
+template <typename Fn>
+int ForEachFaceTriangle(const char *line, const char *end,
+                        const ObjCounts &seen, Fn fn) {
+  Vec3i first, prev, corner;
+  int n = 0;
+  const char *p = line + 2;
+  while ((p = SkipSpaces(p, end)) < end) {
+    p = ParseCorner(p, end, seen, corner);
+    if (n == 0) {
+      first = corner;
+    } else if (n >= 2) {
+      fn(first, prev, corner);
+    }
+    prev = corner;
+    n++;
+  }
+  return n < 3 ? 0 : n - 2;
+}
+
+#endif // GRAPHICS_TINY_READER_OBJ_PARSER_H_
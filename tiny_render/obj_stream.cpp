@@ -0,0 +1,137 @@
+#include "obj_stream.h"
+
+#include <fstream>
+#include <iostream>
+
+#include "profiler.h"
+
+ObjStream::ObjStream(const char *filename, const ObjStreamOptions &options)
+    : options_(options), ready_(options.queue_batches),
+      recycled_(options.queue_batches + 1) {
+  if (options_.vertex_window) {
+    verts_.resize(options_.vertex_window);
+    uvs_.resize(options_.vertex_window);
+  }
+  batch_.reserve(options_.batch_triangles);
+  parser_ = std::thread(&ObjStream::Parse, this, std::string(filename));
+}
+
+ObjStream::~ObjStream() {
+  ready_.Close();
+  recycled_.Close();
+  if (parser_.joinable())
+    parser_.join();
+}
+
+bool ObjStream::Next(std::vector<StreamTriangle> &batch) {
+  if (batch.capacity()) {
+    batch.clear();
+    recycled_.TryPush(std::move(batch));
+  }
+  return ready_.Pop(batch);
+}
+
+void ObjStream::Parse(std::string filename) {
+  PROFILE_SCOPE(kLoad);
+  std::ifstream in(filename, std::ios::binary);
+  if (!in.is_open()) {
+    std::cerr << "can't open file " << filename << "\n";
+    ok_ = false;
+    ready_.Close();
+    return;
+  }
+  // Unparsed tail of the previous chunk followed by the newly read bytes.
+  std::string buffer;
+  bool consumer_alive = true;
+  while (consumer_alive && in) {
+    const size_t tail = buffer.size();
+    buffer.resize(tail + options_.chunk_bytes);
+    in.read(&buffer[tail], options_.chunk_bytes);
+    buffer.resize(tail + in.gcount());
+    const size_t last_newline = buffer.rfind('\n');
+    const size_t complete = in ? (last_newline == std::string::npos
+                                      ? 0
+                                      : last_newline + 1)
+                               : buffer.size();
+    const char *begin = buffer.data();
+    ForEachLine(begin, begin + complete,
+                [&](const char *line, const char *eol) {
+                  if (consumer_alive) {
+                    ParseLine(line, eol);
+                    if (batch_.size() >= options_.batch_triangles)
+                      consumer_alive = Flush();
+                  }
+                });
+    buffer.erase(0, complete);
+  }
+  if (consumer_alive)
+    Flush();
+  std::cout << "Streamed # v# " << seen_.verts << " f# " << seen_.faces
+            << " vt# " << seen_.uvs << std::endl;
+  ready_.Close();
+}
+
+void ObjStream::ParseLine(const char *line, const char *eol) {
+  const size_t window = options_.vertex_window;
+  if (StartsWith(line, eol, "v ")) {
+    Vec3f v;
+    ParseFloats(line + 2, eol, v.raw, 3);
+    if (window) {
+      verts_[seen_.verts % window] = v;
+    } else {
+      verts_.push_back(v);
+    }
+    seen_.verts++;
+  } else if (StartsWith(line, eol, "vt ")) {
+    Vec2f uv;
+    ParseFloats(line + 3, eol, uv.raw, 2);
+    if (window) {
+      uvs_[seen_.uvs % window] = uv;
+    } else {
+      uvs_.push_back(uv);
+    }
+    seen_.uvs++;
+  } else if (StartsWith(line, eol, "vn ")) {
+    seen_.norms++;
+  } else if (StartsWith(line, eol, "f ")) {
+    ForEachFaceTriangle(
+        line, eol, seen_, [&](const Vec3i &a, const Vec3i &b, const Vec3i &c) {
+          StreamTriangle t;
+          if (Resolve(a, t.verts[0], t.uv[0]) &&
+              Resolve(b, t.verts[1], t.uv[1]) &&
+              Resolve(c, t.verts[2], t.uv[2])) {
+            batch_.push_back(t);
+            seen_.faces++;
+          } else {
+            dropped_faces_++;
+          }
+        });
+  }
+}
+
+bool ObjStream::Resolve(const Vec3i &corner, Vec3f &vert, Vec2f &uv) const {
+  const size_t window = options_.vertex_window;
+  const auto resident = [&](int idx, size_t count) {
+    return idx >= 0 && static_cast<size_t>(idx) < count &&
+           (!window || count - idx <= window);
+  };
+  if (!resident(corner.ivert, seen_.verts))
+    return false;
+  vert = verts_[window ? corner.ivert % window : corner.ivert];
+  uv = Vec2f(0, 0);
+  if (resident(corner.iuv, seen_.uvs))
+    uv = uvs_[window ? corner.iuv % window : corner.iuv];
+  return true;
+}
+
+bool ObjStream::Flush() {
+  if (batch_.empty())
+    return true;
+  if (!ready_.Push(std::move(batch_)))
+    return false;
+  if (!recycled_.TryPop(batch_)) {
+    batch_ = std::vector<StreamTriangle>();
+    batch_.reserve(options_.batch_triangles);
+  }
+  return true;
+}
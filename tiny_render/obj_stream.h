@@ -0,0 +1,69 @@
+#ifndef GRAPHICS_TINY_READER_OBJ_STREAM_H_
+#define GRAPHICS_TINY_READER_OBJ_STREAM_H_
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "geometry.h"
+#include "obj_parser.h"
+
+// A face resolved to its vertex data, ready for the rasterizer.
+struct StreamTriangle {
+  Vec3f verts[3];
+  // Normalized texture coordinates; (0, 0) where the face has none.
+  Vec2f uv[3];
+};
+
+struct ObjStreamOptions {
+  // Bytes read from the file per step; lines may span chunks.
+  size_t chunk_bytes = 1 << 20;
+  size_t batch_triangles = 4096;
+  // Parsed batches the reader may run ahead of the consumer.
+  size_t queue_batches = 4;
+  // 0 keeps every vertex and uv resident. Otherwise only the last
+  // vertex_window of each are kept, which suits locally indexed files;
+  // faces that reach further back are dropped.
+  size_t vertex_window = 0;
+};
+
+// Parses an obj file on a background thread in bounded chunks and hands out
+// triangles in batches as they become available, so rendering overlaps
+// parsing and the face list is never held in memory.
+class ObjStream {
+public:
+  explicit ObjStream(const char *filename,
+                     const ObjStreamOptions &options = ObjStreamOptions());
+  ~ObjStream();
+  ObjStream(const ObjStream &) = delete;
+  ObjStream &operator=(const ObjStream &) = delete;
+
+  // Blocks until the next batch is parsed. The previous contents of batch
+  // are recycled. Returns false once the whole file has been consumed.
+  bool Next(std::vector<StreamTriangle> &batch);
+
+  bool ok() const { return ok_; }
+  // Faces skipped because they referenced vertices outside the window.
+  size_t dropped_faces() const { return dropped_faces_; }
+
+private:
+  void Parse(std::string filename);
+  void ParseLine(const char *line, const char *eol);
+  bool Resolve(const Vec3i &corner, Vec3f &vert, Vec2f &uv) const;
+  bool Flush();
+
+  ObjStreamOptions options_;
+  std::vector<Vec3f> verts_;
+  std::vector<Vec2f> uvs_;
+  ObjCounts seen_;
+  std::vector<StreamTriangle> batch_;
+  BoundedQueue<std::vector<StreamTriangle>> ready_;
+  BoundedQueue<std::vector<StreamTriangle>> recycled_;
+  std::atomic<bool> ok_{true};
+  std::atomic<size_t> dropped_faces_{0};
+  std::thread parser_;
+};
+
+#endif // GRAPHICS_TINY_READER_OBJ_STREAM_H_
@@ -0,0 +1,110 @@
+#include "occlusion_query.h"
+
+#include <array>
+#include <vector>
+
+#include "rasterizer.h"
+
+namespace {
+// The corners of a box face, as bit masks of which coordinates come from hi
+// (x = 1, y = 2, z = 4), in the order -x, +x, -y, +y, -z, +z.
+constexpr int kBoxFaces[6][4] = {{0, 2, 6, 4}, {1, 3, 7, 5}, {0, 1, 5, 4},
+                                 {2, 3, 7, 6}, {0, 1, 3, 2}, {4, 5, 7, 6}};
+
+// The camera centre in the space transform maps from, as the homogeneous
+// point (x, y, z, w) that goes to screen x = y = w = 0: the generalized cross
+// product of those three rows. w is 0 for a camera at infinity.
+std::array<float, 4> CameraCentre(const Matrix &transform) {
+  Matrix m = transform;
+  const std::vector<float> *rows[3] = {&m[0], &m[1], &m[3]};
+  std::array<float, 4> centre;
+  for (int j = 0; j < 4; j++) {
+    float minor[3][3];
+    for (int r = 0; r < 3; r++) {
+      for (int c = 0, k = 0; c < 4; c++) {
+        if (c != j)
+          minor[r][k++] = (*rows[r])[c];
+      }
+    }
+    const float det =
+        minor[0][0] * (minor[1][1] * minor[2][2] - minor[1][2] * minor[2][1]) -
+        minor[0][1] * (minor[1][0] * minor[2][2] - minor[1][2] * minor[2][0]) +
+        minor[0][2] * (minor[1][0] * minor[2][1] - minor[1][1] * minor[2][0]);
+    centre[j] = j % 2 ? -det : det;
+  }
+  return centre;
+}
+} // namespace
+
+size_t CountVisibleSamples(std::span<const Vec3f> triangles,
+                           const DepthBuffer &depth, size_t max_samples) {
+  size_t count = 0;
+  const TileRect clip{0, 0, depth.width(), depth.height()};
+  for (size_t i = 0; i + 2 < triangles.size() && count < max_samples;
+       i += 3) {
+    RasterizeTriangle(triangles[i], triangles[i + 1], triangles[i + 2],
+                      Vec2i(), Vec2i(), Vec2i(), clip, depth,
+                      [&](int, int, const Vec2i &) {
+                        return ++count < max_samples;
+                      });
+  }
+  return count;
+}
+
+size_t QueryBox(const Vec3f &lo, const Vec3f &hi, const Matrix &transform,
+                const DepthBuffer &depth, size_t max_samples) {
+  Vec3f screen[8];
+  for (int corner = 0; corner < 8; corner++) {
+    const Vec3f p(corner & 1 ? hi.x : lo.x, corner & 2 ? hi.y : lo.y,
+                  corner & 4 ? hi.z : lo.z);
+    float w;
+    screen[corner] = transform.TransformPoint(p, &w);
+    if (w <= 0.f)
+      return max_samples;
+  }
+  // A face is towards the camera when the camera is on its outer side.
+  const std::array<float, 4> c = CameraCentre(transform);
+  Vec3f triangles[36];
+  size_t n = 0;
+  for (int face = 0; face < 6; face++) {
+    const int axis = face / 2;
+    const float side = face % 2 ? hi[axis] : lo[axis];
+    const float outside = (c[axis] - side * c[3]) * (face % 2 ? 1.f : -1.f);
+    if (c[3] != 0.f && !(outside * c[3] > 0.f))
+      continue;
+    const int *q = kBoxFaces[face];
+    for (int k : {q[0], q[1], q[2], q[0], q[2], q[3]})
+      triangles[n++] = screen[k];
+  }
+  return CountVisibleSamples(std::span<const Vec3f>(triangles, n), depth,
+                             max_samples);
+}
+
+size_t QueryMesh(const Model &proxy, const Matrix &transform,
+                 const DepthBuffer &depth, size_t max_samples) {
+  const std::array<float, 4> c = CameraCentre(transform);
+  std::vector<Vec3f> screen(proxy.nverts());
+  for (size_t v = 0; v < proxy.nverts(); v++) {
+    float w;
+    screen[v] = transform.TransformPoint(proxy.vert(v), &w);
+    if (w <= 0.f)
+      return max_samples;
+  }
+  std::vector<Vec3f> triangles;
+  triangles.reserve(proxy.nfaces() * 3);
+  for (size_t i = 0; i < proxy.nfaces(); i++) {
+    const std::array<size_t, 3> f = proxy.face(i);
+    const Vec3f v0 = proxy.vert(f[0]);
+    // Back faces are skipped, so a closed proxy counts each pixel once.
+    // Obj faces wind counter-clockwise seen from outside, so this is the
+    // outward normal; TransformFace lights by its negation, which faces
+    // away from the camera on the faces it draws.
+    const Vec3f n = (proxy.vert(f[1]) - v0) ^ (proxy.vert(f[2]) - v0);
+    const float outside = n * Vec3f(c[0], c[1], c[2]) - (n * v0) * c[3];
+    if (c[3] != 0.f && !(outside * c[3] > 0.f))
+      continue;
+    for (size_t v : f)
+      triangles.push_back(screen[v]);
+  }
+  return CountVisibleSamples(triangles, depth, max_samples);
+}
@@ -0,0 +1,37 @@
+#ifndef GRAPHICS_TINY_READER_OCCLUSION_QUERY_H_
+#define GRAPHICS_TINY_READER_OCCLUSION_QUERY_H_
+
+#include <cstddef>
+#include <limits>
+#include <span>
+
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "model.h"
+
+// Occlusion queries: proxy geometry is scan converted against a depth buffer
+// without writing it, counting the pixels whose depth would pass the test.
+// A count of zero means anything inside the proxy is hidden behind what the
+// buffer already holds. Counting stops at max_samples, so asking only
+// whether anything is visible costs one passing pixel.
+
+// Counts over screen-space triangles, three vertices each.
+size_t CountVisibleSamples(std::span<const Vec3f> triangles,
+                           const DepthBuffer &depth,
+                           size_t max_samples =
+                               std::numeric_limits<size_t>::max());
+
+// Counts over the faces of the box [lo, hi] that face the camera, with the
+// box carried to screen by transform. A box reaching behind the camera
+// cannot be scan converted and counts as max_samples.
+size_t QueryBox(const Vec3f &lo, const Vec3f &hi, const Matrix &transform,
+                const DepthBuffer &depth,
+                size_t max_samples = std::numeric_limits<size_t>::max());
+
+// Counts over the faces of a proxy mesh, typically a coarse LOD that
+// encloses the real one, carried to screen by transform.
+size_t QueryMesh(const Model &proxy, const Matrix &transform,
+                 const DepthBuffer &depth,
+                 size_t max_samples = std::numeric_limits<size_t>::max());
+
+#endif // GRAPHICS_TINY_READER_OCCLUSION_QUERY_H_
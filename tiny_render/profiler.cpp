@@ -0,0 +1,96 @@
+#include "profiler.h"
+
+#ifdef TINY_RENDER_PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace {
+const char *const kStageNames[Profiler::kNumStages] = {
+    "load", "transform", "cull", "raster", "write"};
+const char *const kCounterNames[Profiler::kNumCounters] = {
+    "triangles_submitted", "triangles_culled", "pixels_tested",
+    "pixels_passed",       "overdraw",         "texture_fetches",
+    "clusters_submitted",  "clusters_culled",  "instances_submitted",
+    "instances_culled",    "instances_occluded"};
+} // namespace
+
+Profiler &Profiler::Instance() {
+  static Profiler profiler;
+  return profiler;
+}
+
+Profiler::ThreadSlot &Profiler::Slot() {
+  thread_local ThreadSlot *slot = nullptr;
+  if (!slot) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slots_.push_back(std::make_unique<ThreadSlot>());
+    slot = slots_.back().get();
+  }
+  return *slot;
+}
+
+void Profiler::EnableOverdrawMap(int width, int height) {
+  overdraw_width_ = width;
+  overdraw_height_ = height;
+  overdraw_.assign(static_cast<size_t>(width) * height, 0);
+}
+
+void Profiler::RecordFragment(int x, int y) {
+  if (x < 0 || y < 0 || x >= overdraw_width_ || y >= overdraw_height_)
+    return;
+  std::atomic_ref<uint16_t>(overdraw_[x + y * overdraw_width_])
+      .fetch_add(1, std::memory_order_relaxed);
+}
+
+TGAImage Profiler::OverdrawHeatmap() const {
+  TGAImage heatmap(overdraw_width_, overdraw_height_, TGAImage::RGB);
+  const uint16_t max_layers =
+      overdraw_.empty() ? 0
+                        : *std::max_element(overdraw_.begin(), overdraw_.end());
+  if (max_layers == 0)
+    return heatmap;
+  for (int y = 0; y < overdraw_height_; y++) {
+    for (int x = 0; x < overdraw_width_; x++) {
+      const uint16_t layers = overdraw_[x + y * overdraw_width_];
+      if (layers == 0)
+        continue;
+      const float t = static_cast<float>(layers) / max_layers;
+      const auto ramp = [](float v) {
+        return static_cast<unsigned char>(std::clamp(v, 0.f, 1.f) * 255);
+      };
+      heatmap.Set(x, y,
+                  TGAColor(ramp(2 * t - 1), ramp(1 - std::abs(2 * t - 1)),
+                           ramp(1 - 2 * t)));
+    }
+  }
+  return heatmap;
+}
+
+void Profiler::EndFrame(std::ostream &out) {
+  int64_t stage_ns[kNumStages] = {};
+  uint64_t counters[kNumCounters] = {};
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto &slot : slots_) {
+      for (int i = 0; i < kNumStages; i++)
+        stage_ns[i] += slot->stage_ns[i].exchange(0, std::memory_order_relaxed);
+      for (int i = 0; i < kNumCounters; i++)
+        counters[i] += slot->counters[i].exchange(0, std::memory_order_relaxed);
+    }
+  }
+  out << "{\"frame\":" << frame_++ << ",\"stages_ms\":{";
+  for (int i = 0; i < kNumStages; i++) {
+    out << (i ? "," : "") << "\"" << kStageNames[i]
+        << "\":" << stage_ns[i] / 1e6;
+  }
+  out << "},\"counters\":{";
+  for (int i = 0; i < kNumCounters; i++) {
+    out << (i ? "," : "") << "\"" << kCounterNames[i] << "\":" << counters[i];
+  }
+  out << "}}\n";
+  out.flush();
+}
+
+#endif // TINY_RENDER_PROFILE
@@ -0,0 +1,135 @@
+#ifndef GRAPHICS_TINY_READER_PROFILER_H_
+#define GRAPHICS_TINY_READER_PROFILER_H_
+
+// Opt-in pipeline instrumentation. Configure with -DTINY_RENDER_PROFILE=ON to
+// get per-stage timers, per-frame counters and an overdraw heatmap; otherwise
+// every PROFILE_* macro expands to nothing and no profiler code is compiled.
+
+#ifdef TINY_RENDER_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "tga_image.h"
+
+class Profiler {
+public:
+  enum Stage { kLoad, kTransform, kCull, kRaster, kWrite, kNumStages };
+  enum Counter {
+    kTrianglesSubmitted,
+    kTrianglesCulled,
+    kPixelsTested,
+    kPixelsPassed,
+    kOverdraw,
+    kTextureFetches,
+    kClustersSubmitted,
+    kClustersCulled,
+    kInstancesSubmitted,
+    kInstancesCulled,
+    kInstancesOccluded,
+    kNumCounters
+  };
+
+  class ScopedTimer {
+  public:
+    explicit ScopedTimer(Stage stage)
+        : stage_(stage), start_(std::chrono::steady_clock::now()) {}
+    ~ScopedTimer() {
+      const auto elapsed = std::chrono::steady_clock::now() - start_;
+      Instance().AddTime(
+          stage_,
+          std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+  private:
+    Stage stage_;
+    std::chrono::steady_clock::time_point start_;
+  };
+
+  static Profiler &Instance();
+
+  void AddTime(Stage stage, int64_t ns) { Add(Slot().stage_ns[stage], ns); }
+  void Count(Counter counter, uint64_t n) { Add(Slot().counters[counter], n); }
+
+  // Starts (or restarts) counting depth-test passes per pixel for the heatmap.
+  void EnableOverdrawMap(int width, int height);
+  void RecordFragment(int x, int y);
+  // Black where nothing was drawn, then blue -> green -> red as the number of
+  // depth-test passes on a pixel approaches the frame maximum.
+  TGAImage OverdrawHeatmap() const;
+
+  // Writes the current frame as one JSON object per line and starts a new one.
+  void EndFrame(std::ostream &out);
+
+private:
+  // Each thread accumulates into its own slot, so the hot path is a relaxed
+  // load and store with no contention; EndFrame sums and clears the slots.
+  struct ThreadSlot {
+    std::atomic<int64_t> stage_ns[kNumStages] = {};
+    std::atomic<uint64_t> counters[kNumCounters] = {};
+  };
+
+  template <typename T> static void Add(std::atomic<T> &value, T n) {
+    value.store(value.load(std::memory_order_relaxed) + n,
+                std::memory_order_relaxed);
+  }
+
+  ThreadSlot &Slot();
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadSlot>> slots_;
+  std::vector<uint16_t> overdraw_;
+  int overdraw_width_ = 0;
+  int overdraw_height_ = 0;
+  int frame_ = 0;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(stage)                                                   \
+  Profiler::ScopedTimer PROFILE_CONCAT(profile_timer_, __LINE__)(              \
+      Profiler::stage)
+#define PROFILE_COUNT(counter, n)                                              \
+  Profiler::Instance().Count(Profiler::counter, (n))
+#define PROFILE_OVERDRAW_MAP(width, height)                                    \
+  Profiler::Instance().EnableOverdrawMap((width), (height))
+#define PROFILE_FRAGMENT(x, y) Profiler::Instance().RecordFragment((x), (y))
+#define PROFILE_WRITE_OVERDRAW(filename)                                       \
+  do {                                                                         \
+    TGAImage profile_heatmap = Profiler::Instance().OverdrawHeatmap();         \
+    profile_heatmap.FlipVertically();                                          \
+    profile_heatmap.WriteTgaFile(filename);                                    \
+  } while (0)
+#define PROFILE_END_FRAME(filename)                                            \
+  do {                                                                         \
+    std::ofstream profile_out(filename, std::ios::app);                        \
+    Profiler::Instance().EndFrame(profile_out);                                \
+  } while (0)
+
+#else
+
+#define PROFILE_SCOPE(stage)
+#define PROFILE_COUNT(counter, n)                                              \
+  do {                                                                         \
+  } while (0)
+#define PROFILE_OVERDRAW_MAP(width, height)                                    \
+  do {                                                                         \
+  } while (0)
+#define PROFILE_FRAGMENT(x, y)                                                 \
+  do {                                                                         \
+  } while (0)
+#define PROFILE_WRITE_OVERDRAW(filename)                                       \
+  do {                                                                         \
+  } while (0)
+#define PROFILE_END_FRAME(filename)                                            \
+  do {                                                                         \
+  } while (0)
+
+#endif // TINY_RENDER_PROFILE
+
+#endif // GRAPHICS_TINY_READER_PROFILER_H_
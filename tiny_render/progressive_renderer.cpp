@@ -0,0 +1,107 @@
+#include "progressive_renderer.h"
+
+#include <algorithm>
+#include <array>
+#include <numeric>
+#include <vector>
+
+#include "face_bins.h"
+#include "profiler.h"
+#include "rasterizer.h"
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+// Faces binned between deadline checks.
+constexpr size_t kFacesPerCheck = 1024;
+
+double MillisecondsSince(Clock::time_point start) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - start)
+      .count();
+}
+} // namespace
+
+ProgressiveStats
+RenderProgressive(const Model &model, const Model &preview,
+                  const Matrix &transform, const Vec3f &light_dir,
+                  std::chrono::steady_clock::time_point deadline,
+                  DepthBuffer &depth, TGAImage &image, int tile_size) {
+  const Clock::time_point start = Clock::now();
+  ProgressiveStats stats;
+  for (size_t i = 0; i < preview.nfaces(); i++) {
+    const std::array<size_t, 3> face = preview.face(i);
+    Vec3f world_coords[3];
+    Vec2i uv[3];
+    for (int j = 0; j < 3; j++) {
+      world_coords[j] = preview.vert(face[j]);
+      uv[j] = preview.uv(i, j);
+    }
+    DrawFace(transform, light_dir, world_coords, uv, preview.diffuse_map(),
+             depth, image);
+  }
+  stats.preview_ms = MillisecondsSince(start);
+
+  const TileGrid grid(image.width(), image.height(), tile_size);
+  stats.tiles = grid.ntiles();
+  // Chunks of faces are binned only when the first tile they may touch is
+  // refined, so a deadline that passes early still leaves refined tiles.
+  const size_t nchunks = (model.nfaces() + kFacesPerCheck - 1) / kFacesPerCheck;
+  std::vector<FaceBins> chunks(nchunks);
+  std::vector<TileRect> reach(nchunks, TileRect{0, 0, 0, 0});
+  std::vector<bool> binned(nchunks, false);
+  {
+    PROFILE_SCOPE(kTransform);
+    for (size_t c = 0; c < nchunks; c++) {
+      FaceRangeTiles(model, c * kFacesPerCheck,
+                     std::min(model.nfaces(), (c + 1) * kFacesPerCheck),
+                     transform, grid, reach[c]);
+    }
+  }
+
+  // Centre tiles first: that is where the subject usually is.
+  std::vector<int> order(stats.tiles);
+  std::iota(order.begin(), order.end(), 0);
+  const auto distance = [&](int t) {
+    const int dx = 2 * (t % grid.tiles_x) + 1 - grid.tiles_x;
+    const int dy = 2 * (t / grid.tiles_x) + 1 - grid.tiles_y;
+    return dx * dx + dy * dy;
+  };
+  std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+    return distance(a) < distance(b);
+  });
+  for (const int tile : order) {
+    const int tx = tile % grid.tiles_x;
+    const int ty = tile / grid.tiles_x;
+    bool ready = true;
+    {
+      PROFILE_SCOPE(kTransform);
+      for (size_t c = 0; ready && c < nchunks; c++) {
+        const TileRect &r = reach[c];
+        if (binned[c] || tx < r.x0 || tx >= r.x1 || ty < r.y0 || ty >= r.y1)
+          continue;
+        ready = Clock::now() < deadline;
+        if (ready) {
+          chunks[c].Bin(model, c * kFacesPerCheck,
+                        std::min(model.nfaces(), (c + 1) * kFacesPerCheck),
+                        transform, light_dir, grid);
+          binned[c] = true;
+        }
+      }
+    }
+    if (!ready || Clock::now() >= deadline)
+      break;
+    // Chunks still unbinned cannot reach the tile, and the rest are drawn
+    // in order, so faces keep model order.
+    PROFILE_SCOPE(kRaster);
+    const TileRect clip = grid.Clip(tile);
+    ClearTile(clip, depth, image);
+    for (size_t c = 0; c < nchunks; c++) {
+      if (binned[c])
+        chunks[c].Draw(tile, model.diffuse_map(), clip, depth, image);
+    }
+    stats.tiles_refined++;
+  }
+  stats.complete = stats.tiles_refined == stats.tiles;
+  stats.elapsed_ms = MillisecondsSince(start);
+  return stats;
+}
@@ -0,0 +1,39 @@
+#ifndef GRAPHICS_TINY_READER_PROGRESSIVE_RENDERER_H_
+#define GRAPHICS_TINY_READER_PROGRESSIVE_RENDERER_H_
+
+#include <chrono>
+
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "model.h"
+#include "tga_image.h"
+
+struct ProgressiveStats {
+  // Tiles redrawn with the full model, out of tiles.
+  size_t tiles_refined = 0;
+  size_t tiles = 0;
+  // Every tile was refined, so the image is the full model's.
+  bool complete = false;
+  // Time spent drawing the preview, and in all.
+  double preview_ms = 0;
+  double elapsed_ms = 0;
+};
+
+// Draws model within a time budget, into an image and depth buffer that
+// start cleared. preview, typically a coarse level of a LodChain, is drawn
+// in full first whatever the deadline, so there is always a whole image.
+// Tiles of tile_size pixels are then cleared and redrawn with the faces of
+// model, from the centre of the image outwards, until the deadline passes.
+// The faces are transformed and binned a chunk at a time, when the first
+// tile the chunk's bounding box may touch comes up, so tiles are refined
+// before the whole model is binned. The deadline is checked between tiles
+// and between chunks of binned faces, so it may be overrun by at most one of
+// those. A complete result is identical to drawing every face of model like
+// a DrawFace loop.
+ProgressiveStats
+RenderProgressive(const Model &model, const Model &preview,
+                  const Matrix &transform, const Vec3f &light_dir,
+                  std::chrono::steady_clock::time_point deadline,
+                  DepthBuffer &depth, TGAImage &image, int tile_size = 32);
+
+#endif // GRAPHICS_TINY_READER_PROGRESSIVE_RENDERER_H_
@@ -0,0 +1,149 @@
+#include "rasterizer.h"
+
+#include <cstring>
+
+#include "profiler.h"
+
+Matrix Viewport(int x, int y, int w, int h) {
+  Matrix m = Matrix::Identity(4);
+  m[0][3] = x + w / 2.f;
+  m[1][3] = y + h / 2.f;
+
+  m[0][0] = w / 2.f;
+  m[1][1] = h / 2.f;
+  m[2][2] = kDepth;
+  return m;
+}
+
+namespace {
+// Projection for a camera distance from the origin on the z axis. w is view
+// depth / distance, and z is the constant near / distance, so that z / w is
+// near / view depth: reversed depth with the far plane at infinity.
+Matrix Projection(float distance, float near) {
+  Matrix projection = Matrix::Identity(4);
+  projection[2][2] = 0.f;
+  projection[2][3] = near / distance;
+  projection[3][2] = -1.f / distance;
+  return projection;
+}
+} // namespace
+
+Matrix PerspectiveTransform(int width, int height, float camera_z,
+                            float near) {
+  return Viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4) *
+         Projection(camera_z, near);
+}
+
+Matrix LookAt(const Vec3f &eye, const Vec3f &center, const Vec3f &up) {
+  Vec3f z = eye - center;
+  z.Normalize();
+  Vec3f x = up ^ z;
+  x.Normalize();
+  Vec3f y = z ^ x;
+  y.Normalize();
+  Matrix rotation = Matrix::Identity(4);
+  Matrix translation = Matrix::Identity(4);
+  for (int i = 0; i < 3; i++) {
+    rotation[0][i] = x[i];
+    rotation[1][i] = y[i];
+    rotation[2][i] = z[i];
+    translation[i][3] = -center[i];
+  }
+  return rotation * translation;
+}
+
+Matrix PerspectiveTransform(int width, int height, const Vec3f &eye,
+                            const Vec3f &center, const Vec3f &up, float near) {
+  return Viewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4) *
+         Projection((eye - center).Norm(), near) * LookAt(eye, center, up);
+}
+
+void DrawTriangle(const Vec3f &t0, const Vec3f &t1, const Vec3f &t2,
+                  Vec2i uv0, Vec2i uv1, Vec2i uv2, const TGAImage &texture,
+                  float intensity, DepthBuffer &depth, TGAImage &image) {
+  DrawTriangle(t0, t1, t2, uv0, uv1, uv2, texture, intensity,
+               TileRect{0, 0, image.width(), image.height()}, depth, image);
+}
+
+void DrawTriangle(const Vec3f &t0, const Vec3f &t1, const Vec3f &t2,
+                  Vec2i uv0, Vec2i uv1, Vec2i uv2, const TGAImage &texture,
+                  float intensity, const TileRect &clip, DepthBuffer &depth,
+                  TGAImage &image) {
+  RasterizeTriangle(t0, t1, t2, uv0, uv1, uv2, clip, depth,
+                    [&](int x, int y, const Vec2i &uv) {
+                      PROFILE_COUNT(kTextureFetches, 1);
+                      TGAColor color = texture.Get(uv.x, uv.y);
+                      image.Set(x, y,
+                                TGAColor(color.r * intensity,
+                                         color.g * intensity,
+                                         color.b * intensity));
+                    });
+}
+
+bool TriangleTiles(const Vec3f &t0, const Vec3f &t1, const Vec3f &t2,
+                   int tile_size, int tiles_x, int tiles_y, TileRect &tiles) {
+  // The rasterizer rounds vertices to whole pixels and may put a span one
+  // pixel further out.
+  int x0 = std::numeric_limits<int>::max(), y0 = x0;
+  int x1 = std::numeric_limits<int>::min(), y1 = x1;
+  for (const Vec3i p : {Vec3i(t0), Vec3i(t1), Vec3i(t2)}) {
+    x0 = std::min(x0, p.x - 1);
+    y0 = std::min(y0, p.y - 1);
+    x1 = std::max(x1, p.x + 1);
+    y1 = std::max(y1, p.y + 1);
+  }
+  if (x1 < 0 || y1 < 0)
+    return false;
+  tiles = TileRect{std::max(x0, 0) / tile_size, std::max(y0, 0) / tile_size,
+                   std::min(x1 / tile_size + 1, tiles_x),
+                   std::min(y1 / tile_size + 1, tiles_y)};
+  return tiles.x0 < tiles.x1 && tiles.y0 < tiles.y1;
+}
+
+void ClearTile(const TileRect &clip, DepthBuffer &depth, TGAImage &image) {
+  const int bpp = image.bytes_per_pixel();
+  const size_t bytes_per_line = static_cast<size_t>(image.width()) * bpp;
+  for (int y = clip.y0; y < clip.y1; y++) {
+    memset(image.data() + y * bytes_per_line + clip.x0 * bpp, 0,
+           (clip.x1 - clip.x0) * bpp);
+  }
+  depth.Clear(clip.x0, clip.y0, clip.x1, clip.y1);
+}
+
+bool TransformFace(const Matrix &transform, const Vec3f &light_dir,
+                   const Vec3f world_coords[3], Vec3f screen_coords[3],
+                   float &intensity) {
+  PROFILE_COUNT(kTrianglesSubmitted, 1);
+  {
+    PROFILE_SCOPE(kTransform);
+    for (int j = 0; j < 3; j++) {
+      screen_coords[j] = transform.TransformPoint(world_coords[j]);
+    }
+  }
+  {
+    PROFILE_SCOPE(kCull);
+    Vec3f n = (world_coords[2] - world_coords[0]) ^
+              (world_coords[1] - world_coords[0]);
+    n.Normalize();
+    intensity = n * light_dir;
+  }
+  if (!(intensity > 0)) {
+    PROFILE_COUNT(kTrianglesCulled, 1);
+    return false;
+  }
+  return true;
+}
+
+bool DrawFace(const Matrix &transform, const Vec3f &light_dir,
+              const Vec3f world_coords[3], const Vec2i uv[3],
+              const TGAImage &texture, DepthBuffer &depth, TGAImage &image) {
+  Vec3f screen_coords[3];
+  float intensity;
+  if (!TransformFace(transform, light_dir, world_coords, screen_coords,
+                     intensity))
+    return false;
+  PROFILE_SCOPE(kRaster);
+  DrawTriangle(screen_coords[0], screen_coords[1], screen_coords[2], uv[0],
+               uv[1], uv[2], texture, intensity, depth, image);
+  return true;
+}
@@ -0,0 +1,188 @@
+#ifndef GRAPHICS_TINY_READER_RASTERIZER_H_
+#define GRAPHICS_TINY_READER_RASTERIZER_H_
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+#include "depth_buffer.h"
+#include "geometry.h"
+#include "profiler.h"
+#include "tga_image.h"
+
+// The perspective pipeline of main_4, shared by every renderer built on top
+// of it: vertices go through viewport * projection, faces turned away from
+// the light are culled, and the rest are scan converted against a z-buffer
+// and textured.
+
+// Maps x and y in [-1, 1] onto the w x h rectangle at (x, y), and z in
+// [0, 1] onto [0, kDepth].
+Matrix Viewport(int x, int y, int w, int h);
+
+// Distance from the camera, in world units, at which screen z reaches
+// kDepth.
+constexpr float kNearPlane = 1.f;
+
+// Viewport * projection for a camera on the z axis at camera_z, drawing into
+// the central 3/4 of a width x height target. Screen z is kDepth * near /
+// view depth: kDepth on the near plane, falling towards 0 at infinity, and
+// above kDepth only for points nearer than near.
+Matrix PerspectiveTransform(int width, int height, float camera_z,
+                            float near = kNearPlane);
+
+// World to camera space for a camera at eye looking at center.
+Matrix LookAt(const Vec3f &eye, const Vec3f &center, const Vec3f &up);
+
+// Viewport * projection * LookAt for a camera anywhere; equal to the camera_z
+// version for eye (0, 0, camera_z) and center at the origin.
+Matrix PerspectiveTransform(int width, int height, const Vec3f &eye,
+                            const Vec3f &center,
+                            const Vec3f &up = Vec3f(0, 1, 0),
+                            float near = kNearPlane);
+
+// Half-open pixel rectangle [x0, x1) x [y0, y1).
+struct TileRect {
+  int x0;
+  int y0;
+  int x1;
+  int y1;
+};
+
+// Scan converts a screen-space triangle, calling fragment(x, y, uv) for
+// every pixel inside clip that passes the depth test against depth after the
+// depth has been written. x and y are rounded to whole pixels, z is
+// interpolated unrounded and stored as Format encodes it. A pixel is drawn
+// the same way whatever clip it is drawn through, so a triangle drawn once
+// per tile gives the same image as drawing it whole.
+//
+// Given a const depth buffer the triangle is only tested: nothing is
+// written, and the fragment sees the pixels that would pass. A fragment that
+// returns bool stops the scan by returning false.
+template <typename Format, typename Depth, typename Fragment>
+void RasterizeTriangle(const Vec3f &v0, const Vec3f &v1, const Vec3f &v2,
+                       Vec2i uv0, Vec2i uv1, Vec2i uv2, const TileRect &clip,
+                       Depth &depth, Fragment fragment) {
+  static_assert(std::is_same_v<std::remove_const_t<Depth>, DepthBuffer>);
+  Vec3i t0 = v0, t1 = v1, t2 = v2;
+  float z0 = v0.z, z1 = v1.z, z2 = v2.z;
+  if (t0.y == t1.y && t0.y == t2.y)
+    return;
+  if (t0.y > t1.y) {
+    std::swap(t0, t1);
+    std::swap(z0, z1);
+    std::swap(uv0, uv1);
+  }
+  if (t0.y > t2.y) {
+    std::swap(t0, t2);
+    std::swap(z0, z2);
+    std::swap(uv0, uv2);
+  }
+  if (t1.y > t2.y) {
+    std::swap(t1, t2);
+    std::swap(z1, z2);
+    std::swap(uv1, uv2);
+  }
+
+  const int width = depth.width();
+  auto *depth_data = depth.data();
+  int total_height = t2.y - t0.y;
+  // Rounding can put a span a pixel off its nominal row or column, so the
+  // loops keep a one pixel margin around clip and test each pixel exactly.
+  const int first_row = std::max(0, clip.y0 - 1 - t0.y);
+  const int last_row = std::min(total_height, clip.y1 + 1 - t0.y);
+  for (int i = first_row; i < last_row; i++) {
+    bool second_half = i > t1.y - t0.y || t1.y == t0.y;
+    int segment_height = second_half ? t2.y - t1.y : t1.y - t0.y;
+    float alpha = (float)i / total_height;
+    float beta = (float)(i - (second_half ? t1.y - t0.y : 0)) / segment_height;
+    Vec3i A = t0 + Vec3f(t2 - t0) * alpha;
+    Vec3i B =
+        second_half ? t1 + Vec3f(t2 - t1) * beta : t0 + Vec3f(t1 - t0) * beta;
+    float zA = z0 + (z2 - z0) * alpha;
+    float zB = second_half ? z1 + (z2 - z1) * beta : z0 + (z1 - z0) * beta;
+    Vec2i uvA = uv0 + (uv2 - uv0) * alpha;
+    Vec2i uvB =
+        second_half ? uv1 + (uv2 - uv1) * beta : uv0 + (uv1 - uv0) * beta;
+    if (A.x > B.x) {
+      std::swap(A, B);
+      std::swap(zA, zB);
+      std::swap(uvA, uvB);
+    }
+    const int last = std::min(B.x, clip.x1);
+    for (int j = std::max(A.x, clip.x0 - 1); j <= last; j++) {
+      float phi = B.x == A.x ? 1. : (float)(j - A.x) / (float)(B.x - A.x);
+      Vec3i P = Vec3f(A) + Vec3f(B - A) * phi;
+      Vec2i uvP = uvA + (uvB - uvA) * phi;
+      if (P.x < clip.x0 || P.y < clip.y0 || P.x >= clip.x1 || P.y >= clip.y1)
+        continue;
+      const size_t idx = P.x + static_cast<size_t>(P.y) * width;
+      const typename Format::Value stored = Format::Load(depth_data, idx);
+      const typename Format::Value z = Format::Encode(zA + (zB - zA) * phi);
+      // Queries through a const depth draw nothing, so they stay out of the
+      // pixel counters.
+      if constexpr (!std::is_const_v<Depth>)
+        PROFILE_COUNT(kPixelsTested, 1);
+      if (stored < z) {
+        if constexpr (!std::is_const_v<Depth>) {
+          PROFILE_COUNT(kPixelsPassed, 1);
+          PROFILE_COUNT(kOverdraw, stored != Format::kClear);
+          PROFILE_FRAGMENT(P.x, P.y);
+          Format::Store(depth_data, idx, z);
+        }
+        if constexpr (std::is_same_v<decltype(fragment(P.x, P.y, uvP)),
+                                     bool>) {
+          if (!fragment(P.x, P.y, uvP))
+            return;
+        } else {
+          fragment(P.x, P.y, uvP);
+        }
+      }
+    }
+  }
+}
+
+// Runs RasterizeTriangle specialized for depth's format.
+template <typename Depth, typename Fragment>
+void RasterizeTriangle(const Vec3f &v0, const Vec3f &v1, const Vec3f &v2,
+                       Vec2i uv0, Vec2i uv1, Vec2i uv2, const TileRect &clip,
+                       Depth &depth, Fragment fragment) {
+  VisitDepthFormat(depth.format(), [&](auto format) {
+    RasterizeTriangle<decltype(format)>(v0, v1, v2, uv0, uv1, uv2, clip,
+                                        depth, fragment);
+  });
+}
+
+// depth is as large as image.
+void DrawTriangle(const Vec3f &t0, const Vec3f &t1, const Vec3f &t2,
+                  Vec2i uv0, Vec2i uv1, Vec2i uv2, const TGAImage &texture,
+                  float intensity, DepthBuffer &depth, TGAImage &image);
+// Draws only the part of the triangle inside clip.
+void DrawTriangle(const Vec3f &t0, const Vec3f &t1, const Vec3f &t2,
+                  Vec2i uv0, Vec2i uv1, Vec2i uv2, const TGAImage &texture,
+                  float intensity, const TileRect &clip, DepthBuffer &depth,
+                  TGAImage &image);
+
+// The tiles, as a half-open range of tile coordinates in a tiles_x x tiles_y
+// grid of tile_size pixel tiles, that drawing the screen triangle t0 t1 t2
+// may touch. Returns false if it touches none.
+bool TriangleTiles(const Vec3f &t0, const Vec3f &t1, const Vec3f &t2,
+                   int tile_size, int tiles_x, int tiles_y, TileRect &tiles);
+
+// Clears the pixels of image and depth inside clip.
+void ClearTile(const TileRect &clip, DepthBuffer &depth, TGAImage &image);
+
+// The transform and cull stages of DrawFace: projects the object-space
+// vertices to screen_coords and computes the light intensity. Returns false
+// if the face is culled.
+bool TransformFace(const Matrix &transform, const Vec3f &light_dir,
+                   const Vec3f world_coords[3], Vec3f screen_coords[3],
+                   float &intensity);
+
+// Transforms, culls and draws one face given its object-space vertices and
+// texel uvs. Returns false if the face was culled.
+bool DrawFace(const Matrix &transform, const Vec3f &light_dir,
+              const Vec3f world_coords[3], const Vec2i uv[3],
+              const TGAImage &texture, DepthBuffer &depth, TGAImage &image);
+
+#endif // GRAPHICS_TINY_READER_RASTERIZER_H_
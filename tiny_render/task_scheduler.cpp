@@ -0,0 +1,166 @@
+#include "task_scheduler.h"
+
+#include <algorithm>
+
+namespace {
+// The pool and queue of the calling thread, if it is a worker.
+thread_local const TaskScheduler *tls_scheduler = nullptr;
+thread_local size_t tls_queue = 0;
+} // namespace
+
+TaskGraph::TaskId TaskGraph::Add(std::function<void()> fn,
+                                 std::initializer_list<TaskId> after) {
+  const TaskId id = nodes_.size();
+  nodes_.emplace_back().fn = std::move(fn);
+  for (TaskId before : after)
+    Precede(before, id);
+  return id;
+}
+
+void TaskGraph::Precede(TaskId before, TaskId after) {
+  nodes_[before].successors.push_back(after);
+  nodes_[after].dependencies++;
+}
+
+TaskScheduler::TaskScheduler(int threads) {
+  if (threads <= 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  for (int i = 0; i < threads; i++)
+    queues_.push_back(std::make_unique<Queue>());
+  for (int i = 0; i + 1 < threads; i++)
+    workers_.emplace_back(&TaskScheduler::WorkerLoop, this, i);
+}
+
+TaskScheduler::~TaskScheduler() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (std::thread &worker : workers_)
+    worker.join();
+}
+
+size_t TaskScheduler::QueueIndex() const {
+  return tls_scheduler == this ? tls_queue : queues_.size() - 1;
+}
+
+void TaskScheduler::Push(std::function<void()> task) {
+  Queue &queue = *queues_[QueueIndex()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  queued_.fetch_add(1);
+  // Taking the lock orders this wake-up after any worker's check of queued_,
+  // so a worker that is about to sleep cannot miss it.
+  { std::lock_guard<std::mutex> lock(sleep_mutex_); }
+  wake_.notify_one();
+}
+
+bool TaskScheduler::RunOne() {
+  const size_t self = QueueIndex();
+  std::function<void()> task;
+  {
+    Queue &own = *queues_[self];
+    std::lock_guard<std::mutex> lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.back());
+      own.tasks.pop_back();
+    }
+  }
+  for (size_t i = 1; !task && i < queues_.size(); i++) {
+    Queue &victim = *queues_[(self + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.front());
+      victim.tasks.pop_front();
+    }
+  }
+  if (!task)
+    return false;
+  queued_.fetch_sub(1);
+  task();
+  return true;
+}
+
+void TaskScheduler::WorkerLoop(size_t index) {
+  tls_scheduler = this;
+  tls_queue = index;
+  while (true) {
+    if (RunOne())
+      continue;
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    wake_.wait(lock, [&] { return stop_ || queued_.load() > 0; });
+    if (stop_ && queued_.load() == 0)
+      return;
+  }
+}
+
+// Lives on the heap, owned by the queued tasks and Run, because the last
+// task still touches it after Run may have seen the graph finish.
+struct TaskScheduler::GraphRun {
+  TaskGraph *graph;
+  std::atomic<size_t> remaining;
+};
+
+void TaskScheduler::RunNode(const std::shared_ptr<GraphRun> &run, size_t id) {
+  TaskGraph::Node &node = run->graph->nodes_[id];
+  node.fn();
+  for (TaskGraph::TaskId next : node.successors) {
+    if (run->graph->nodes_[next].pending.fetch_sub(1) == 1)
+      Push([this, run, next] { RunNode(run, next); });
+  }
+  run->remaining.fetch_sub(1);
+  run->remaining.notify_all();
+}
+
+void TaskScheduler::Run(TaskGraph &graph) {
+  if (graph.nodes_.empty())
+    return;
+  auto run = std::make_shared<GraphRun>();
+  run->graph = &graph;
+  run->remaining = graph.nodes_.size();
+  for (TaskGraph::Node &node : graph.nodes_)
+    node.pending = node.dependencies;
+  for (TaskGraph::TaskId id = 0; id < graph.nodes_.size(); id++) {
+    if (graph.nodes_[id].dependencies == 0)
+      Push([this, run, id] { RunNode(run, id); });
+  }
+  // Help until the graph is done; when there is nothing left to take, sleep
+  // until one of its tasks finishes.
+  for (size_t left = run->remaining.load(); left > 0;
+       left = run->remaining.load()) {
+    if (!RunOne())
+      run->remaining.wait(left);
+  }
+}
+
+void TaskScheduler::ParallelFor(size_t begin, size_t end, size_t grain,
+                                const std::function<void(size_t, size_t)> &fn) {
+  grain = std::max<size_t>(grain, 1);
+  TaskGraph graph;
+  for (size_t first = begin; first < end; first += grain) {
+    const size_t last = std::min(end, first + grain);
+    graph.Add([&fn, first, last] { fn(first, last); });
+  }
+  Run(graph);
+}
+
+void TaskScheduler::Spawn(TaskGroup &group, std::function<void()> fn) {
+  group.state_->pending.fetch_add(1);
+  Push([state = group.state_, fn = std::move(fn)] {
+    fn();
+    state->pending.fetch_sub(1);
+    state->pending.notify_all();
+  });
+}
+
+void TaskScheduler::Wait(TaskGroup &group, size_t max_pending) {
+  const std::shared_ptr<TaskGroup::State> state = group.state_;
+  for (size_t left = state->pending.load(); left > max_pending;
+       left = state->pending.load()) {
+    if (!RunOne())
+      state->pending.wait(left);
+  }
+}
@@ -0,0 +1,119 @@
+#ifndef GRAPHICS_TINY_READER_TASK_SCHEDULER_H_
+#define GRAPHICS_TINY_READER_TASK_SCHEDULER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A set of tasks and the order constraints between them, run as a whole by
+// TaskScheduler::Run. A graph can be run any number of times.
+class TaskGraph {
+public:
+  using TaskId = size_t;
+
+  // Adds a task that starts only after every task in after has finished.
+  TaskId Add(std::function<void()> fn, std::initializer_list<TaskId> after = {});
+  // Makes after wait for before.
+  void Precede(TaskId before, TaskId after);
+
+  size_t size() const { return nodes_.size(); }
+
+private:
+  friend class TaskScheduler;
+
+  struct Node {
+    std::function<void()> fn;
+    std::vector<TaskId> successors;
+    int dependencies = 0;
+    std::atomic<int> pending = 0;
+  };
+
+  // A deque so nodes, which hold atomics, never move.
+  std::deque<Node> nodes_;
+};
+
+// Tasks started one at a time with TaskScheduler::Spawn, for work that
+// arrives while earlier work is running.
+class TaskGroup {
+public:
+  // Tasks spawned and not yet finished.
+  size_t pending() const { return state_->pending.load(); }
+
+private:
+  friend class TaskScheduler;
+
+  // Shared with the queued tasks, since the last one still signals it after
+  // a waiter may have seen the group finish.
+  struct State {
+    std::atomic<size_t> pending = 0;
+  };
+  std::shared_ptr<State> state_ = std::make_shared<State>();
+};
+
+// Work-stealing thread pool. Every worker owns a deque: it pushes and pops
+// its own tasks at the back, newest first for cache locality, while idle
+// workers steal the oldest tasks from the front of other deques. Tasks queued
+// from outside the pool go to a shared deque that every worker steals from.
+// A thread waiting in Run runs tasks itself instead of blocking, so tasks may
+// run nested graphs.
+class TaskScheduler {
+public:
+  // threads counts the caller of Run, so threads - 1 workers are started; 0
+  // means one per core.
+  explicit TaskScheduler(int threads = 0);
+  ~TaskScheduler();
+
+  TaskScheduler(const TaskScheduler &) = delete;
+  TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+  int threads() const { return static_cast<int>(workers_.size()) + 1; }
+
+  // Runs every task of graph, respecting its order constraints, and returns
+  // when all have finished.
+  void Run(TaskGraph &graph);
+  // Calls fn(first, last) over [begin, end) split into ranges of at most
+  // grain elements, in parallel.
+  void ParallelFor(size_t begin, size_t end, size_t grain,
+                   const std::function<void(size_t, size_t)> &fn);
+  // Queues fn as a task of group and returns at once.
+  void Spawn(TaskGroup &group, std::function<void()> fn);
+  // Runs tasks on the calling thread, like Run, until at most max_pending of
+  // group's tasks are unfinished.
+  void Wait(TaskGroup &group, size_t max_pending = 0);
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<std::function<void()>> tasks;
+  };
+
+  struct GraphRun;
+
+  void Push(std::function<void()> task);
+  // Runs a node, then queues every successor it was the last dependency of.
+  void RunNode(const std::shared_ptr<GraphRun> &run, size_t id);
+  // Runs one queued task, preferring the calling worker's own. Returns false
+  // if every queue was empty.
+  bool RunOne();
+  void WorkerLoop(size_t index);
+  // Index of the calling thread's queue, or the shared queue for threads
+  // outside the pool.
+  size_t QueueIndex() const;
+
+  // One queue per worker, then the shared one.
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<size_t> queued_ = 0;
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+  bool stop_ = false;
+};
+
+#endif // GRAPHICS_TINY_READER_TASK_SCHEDULER_H_
@@ -0,0 +1,1103 @@
+// Golden-image and timing regression tests. Every scene renders a fixed view
+// of obj/african_head.obj or of a generated mesh through one pipeline and is
+// compared with tests/golden/<scene>.tga; on a mismatch the rendered image
+// and a diff image (mismatched pixels in red) are written to the working
+// directory. Each scene also times its stages, best of kRuns, against the
+// limits in --thresholds, if given.
+//
+// Usage: render_tests [--update] [--golden-dir dir] [--obj-dir dir]
+//                     [--thresholds file] [--perf-scale s] [--timing-only]
+//                     [scene...]
+// --update rewrites the golden images instead of comparing, and
+// --timing-only checks only the times. Without scene names every scene runs.
+
+#include "asset_cache.h"
+#include "compact_mesh.h"
+#include "depth_buffer.h"
+#include "frame_sink.h"
+#include "frame_writer.h"
+#include "framebuffer_pool.h"
+#include "gbuffer.h"
+#include "geometry.h"
+#include "image_ops.h"
+#include "incremental_renderer.h"
+#include "instanced_scene.h"
+#include "mesh_simplifier.h"
+#include "meshlet.h"
+#include "model.h"
+#include "msaa.h"
+#include "obj_stream.h"
+#include "occlusion_query.h"
+#include "progressive_renderer.h"
+#include "rasterizer.h"
+#include "task_scheduler.h"
+#include "tga_image.h"
+#include "tiled_renderer.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+constexpr int kSize = 256;
+constexpr int kRuns = 3;
+constexpr float kPi = 3.14159265f;
+
+struct Options {
+  bool update = false;
+  std::string golden_dir = "golden";
+  std::string obj_dir = "../obj";
+  std::string thresholds;
+  double perf_scale = 1.0;
+  bool timing_only = false;
+};
+
+// What one run of a scene measured: milliseconds per stage name, and the
+// behaviour checks that failed, which fail the scene in every mode.
+struct StageTimes {
+  std::map<std::string, double> ms;
+  std::vector<std::string> failed;
+};
+
+// Records that check did not hold; returns the empty image scenes give up
+// with.
+TGAImage Fail(StageTimes &times, const char *check) {
+  times.failed.push_back(check);
+  return TGAImage();
+}
+
+class StageTimer {
+public:
+  StageTimer(StageTimes &times, const char *stage)
+      : times_(times), stage_(stage),
+        start_(std::chrono::steady_clock::now()) {}
+  ~StageTimer() {
+    times_.ms[stage_] += std::chrono::duration<double, std::milli>(
+                          std::chrono::steady_clock::now() - start_)
+                          .count();
+  }
+
+private:
+  StageTimes &times_;
+  const char *stage_;
+  std::chrono::steady_clock::time_point start_;
+};
+
+struct Scene {
+  const char *name;
+  // Golden image to compare with; scenes that must match another pipeline
+  // exactly share its golden.
+  const char *golden;
+  // Largest per-channel difference that still counts as a match, and the
+  // fraction of pixels allowed to exceed it.
+  int tolerance;
+  double max_mismatch;
+  std::function<TGAImage(StageTimes &)> render;
+};
+
+const Options *options = nullptr;
+AssetCache cache;
+
+std::shared_ptr<const Model> Head() {
+  return cache.GetModel(options->obj_dir + "/african_head.obj");
+}
+
+Matrix SceneTransform(const Vec3f &eye) {
+  return PerspectiveTransform(kSize, kSize, eye, Vec3f(0, 0, 0));
+}
+
+void DrawFaces(const Model &model, const Matrix &transform,
+               const Vec3f &light_dir, DepthBuffer &depth, TGAImage &image) {
+  for (size_t i = 0; i < model.nfaces(); i++) {
+    const std::array<size_t, 3> face = model.face(i);
+    Vec3f world_coords[3];
+    Vec2i uv[3];
+    for (int j = 0; j < 3; j++) {
+      world_coords[j] = model.vert(face[j]);
+      uv[j] = model.uv(i, j);
+    }
+    DrawFace(transform, light_dir, world_coords, uv, model.diffuse_map(),
+             depth, image);
+  }
+}
+
+// Reads exactly n bytes from fd unless it ends first.
+void ReadAll(int fd, unsigned char *data, size_t n) {
+  while (n > 0) {
+    const ssize_t got = read(fd, data, n);
+    if (got <= 0)
+      return;
+    data += got;
+    n -= got;
+  }
+}
+
+// Forward render of model with the camera at eye and a headlight.
+TGAImage RenderForward(const Model &model, const Vec3f &eye,
+                       DepthFormat format, StageTimes &times) {
+  StageTimer timer(times, "render");
+  Vec3f light_dir = eye * -1.f;
+  light_dir.Normalize();
+  DepthBuffer depth(kSize, kSize, format);
+  TGAImage image(kSize, kSize, TGAImage::RGB);
+  DrawFaces(model, SceneTransform(eye), light_dir, depth, image);
+  return image;
+}
+
+std::shared_ptr<const TGAImage> Checkerboard(int size, int squares) {
+  auto image = std::make_shared<TGAImage>(size, size, TGAImage::RGB,
+                                          TGAImage::RowOrder::kBottomUp);
+  for (int y = 0; y < size; y++) {
+    for (int x = 0; x < size; x++) {
+      const bool odd = (x * squares / size + y * squares / size) % 2;
+      image->Set(x, y, odd ? TGAColor(230, 190, 60) : TGAColor(40, 90, 200));
+    }
+  }
+  return image;
+}
+
+// A torus around the y axis as a grid of quads, split into two triangles
+// each; uv wraps once around both circles.
+struct Mesh {
+  std::vector<Vec3f> verts;
+  std::vector<Vec2f> uvs;
+  std::vector<Vec3f> norms;
+  std::vector<Vec3i> corners;
+};
+
+Mesh Torus(int rings, int segments, float major, float minor) {
+  Mesh mesh;
+  for (int r = 0; r <= rings; r++) {
+    const float u = 2.f * kPi * r / rings;
+    for (int s = 0; s <= segments; s++) {
+      const float v = 2.f * kPi * s / segments;
+      const Vec3f normal(std::cos(u) * std::cos(v), std::sin(v),
+                         std::sin(u) * std::cos(v));
+      mesh.verts.push_back(
+          Vec3f(std::cos(u) * major, 0, std::sin(u) * major) + normal * minor);
+      mesh.uvs.push_back(
+          Vec2f(static_cast<float>(r) / rings, static_cast<float>(s) / segments));
+      mesh.norms.push_back(normal);
+    }
+  }
+  const auto index = [&](int r, int s) {
+    const int i = r * (segments + 1) + s;
+    return Vec3i(i, i, i);
+  };
+  for (int r = 0; r < rings; r++) {
+    for (int s = 0; s < segments; s++) {
+      const Vec3i quad[4] = {index(r, s), index(r + 1, s), index(r + 1, s + 1),
+                             index(r, s + 1)};
+      for (const int k : {0, 1, 2, 0, 2, 3})
+        mesh.corners.push_back(quad[k]);
+    }
+  }
+  return mesh;
+}
+
+// The same torus with each vertex stored once: the corners along the two
+// wrap-around seams share a vertex but have the uvs of either side.
+Mesh SeamTorus(int rings, int segments, float major, float minor) {
+  Mesh grid = Torus(rings, segments, major, minor);
+  Mesh mesh;
+  mesh.uvs = grid.uvs;
+  const auto welded = [&](int i) {
+    const int r = i / (segments + 1) % rings;
+    const int s = i % (segments + 1) % segments;
+    return r * segments + s;
+  };
+  for (int r = 0; r < rings; r++) {
+    for (int s = 0; s < segments; s++) {
+      mesh.verts.push_back(grid.verts[r * (segments + 1) + s]);
+      mesh.norms.push_back(grid.norms[r * (segments + 1) + s]);
+    }
+  }
+  for (const Vec3i &corner : grid.corners) {
+    const int v = welded(corner.ivert);
+    mesh.corners.push_back(Vec3i(v, corner.iuv, v));
+  }
+  return mesh;
+}
+
+// Whether every corner of lod keeps a uv its vertex had in original, from
+// the chart of the face it is in: a face's uvs must lie less than half a
+// turn apart, which a corner given the far side of a seam breaks.
+bool SeamUvsKept(const Model &original, const Model &lod) {
+  std::map<std::array<float, 3>, std::vector<int>> uvs_at;
+  for (const Vec3i &corner : original.corners()) {
+    const Vec3f p = original.vert(corner.ivert);
+    uvs_at[{p.x, p.y, p.z}].push_back(corner.iuv);
+  }
+  for (size_t f = 0; f < lod.nfaces(); f++) {
+    Vec2f lo(1, 1), hi(0, 0);
+    for (int k = 0; k < 3; k++) {
+      const Vec3i &corner = lod.corners()[f * 3 + k];
+      const Vec3f p = lod.vert(corner.ivert);
+      const Vec2f uv = lod.uvs()[corner.iuv];
+      const auto found = uvs_at.find({p.x, p.y, p.z});
+      if (found == uvs_at.end() ||
+          std::none_of(found->second.begin(), found->second.end(),
+                       [&](int i) {
+                         return original.uvs()[i].x == uv.x &&
+                                original.uvs()[i].y == uv.y;
+                       }))
+        return false;
+      for (int i = 0; i < 2; i++) {
+        lo.raw[i] = std::min(lo.raw[i], uv.raw[i]);
+        hi.raw[i] = std::max(hi.raw[i], uv.raw[i]);
+      }
+    }
+    if (hi.x - lo.x >= 0.5f || hi.y - lo.y >= 0.5f)
+      return false;
+  }
+  return true;
+}
+
+// Writes mesh as an obj file of quads, giving every other quad negative
+// (relative) indices, with tex as its diffuse texture.
+bool WriteObj(const Mesh &mesh, const TGAImage &tex, const std::string &path) {
+  // Other test processes may be reading the previous files, so the new ones
+  // are written aside and renamed over them.
+  const std::string texture = Model::TexturePath(path, "_diffuse.tga");
+  std::ofstream out(path + ".tmp");
+  // Enough digits to read back the same floats.
+  out.precision(9);
+  for (const Vec3f &v : mesh.verts)
+    out << "v " << v.x << " " << v.y << " " << v.z << "\n";
+  for (const Vec2f &uv : mesh.uvs)
+    out << "vt " << uv.x << " " << uv.y << "\n";
+  for (const Vec3f &n : mesh.norms)
+    out << "vn " << n.x << " " << n.y << " " << n.z << "\n";
+  const int count = static_cast<int>(mesh.verts.size());
+  for (size_t q = 0; q < mesh.corners.size() / 6; q++) {
+    const Vec3i *c = &mesh.corners[q * 6];
+    out << "f";
+    for (const Vec3i &corner : {c[0], c[1], c[2], c[5]}) {
+      const int i = q % 2 ? corner.ivert - count : corner.ivert + 1;
+      out << " " << i << "/" << i << "/" << i;
+    }
+    out << "\n";
+  }
+  out.close();
+  if (!out.good() || !tex.WriteTgaFile((texture + ".tmp").c_str(), false))
+    return false;
+  std::error_code error;
+  std::filesystem::rename(path + ".tmp", path, error);
+  if (!error)
+    std::filesystem::rename(texture + ".tmp", texture, error);
+  return !error;
+}
+
+// Whether two models hold byte-identical mesh arrays.
+bool SameArrays(const Model &a, const Model &b) {
+  const auto same = [](auto x, auto y) {
+    return x.size() == y.size() &&
+           std::memcmp(x.data(), y.data(), x.size_bytes()) == 0;
+  };
+  return same(a.verts(), b.verts()) && same(a.uvs(), b.uvs()) &&
+         same(a.norms(), b.norms()) && same(a.corners(), b.corners());
+}
+
+const std::string &TorusObj() {
+  static const std::string path = [] {
+    const std::string file = "render_tests_torus.obj";
+    WriteObj(Torus(48, 24, 0.6f, 0.25f), *Checkerboard(256, 16), file);
+    return file;
+  }();
+  return path;
+}
+
+const Vec3f kFront(0, 0, 3);
+const Vec3f kTorusEye(0, 1.8f, 2.4f);
+const Vec3f kCrowdEye(0, 1.5f, 3.f);
+
+// A 17 x 17 grid of small heads and tori on the y = 0 plane, most of it
+// outside the view from kCrowdEye.
+InstancedScene Crowd() {
+  InstancedScene scene;
+  const InstancedScene::ModelId head = scene.AddModel(Head());
+  const Mesh mesh = Torus(48, 24, 0.6f, 0.25f);
+  const InstancedScene::ModelId torus = scene.AddModel(
+      std::make_shared<Model>(mesh.verts, mesh.uvs, mesh.norms, mesh.corners,
+                              Checkerboard(256, 16)));
+  for (int i = 0; i < 17; i++) {
+    for (int j = 0; j < 17; j++) {
+      const Vec3f position(i * 0.5f - 4.f, 0, j * 0.5f - 4.f);
+      scene.AddInstance((i + j) % 3 ? head : torus,
+                        PlaceObject(position, 0.4f * (i - j), 0.2f));
+    }
+  }
+  return scene;
+}
+
+// Moves two instances of the crowd and adds a third.
+void EditCrowd(InstancedScene &scene) {
+  scene.SetWorld(144, PlaceObject(Vec3f(0.15f, 0, 0), 1.f, 0.2f));
+  scene.SetWorld(146, PlaceObject(Vec3f(0, 0.1f, 1.f), 0.f, 0.25f));
+  scene.AddInstance(scene.model_of(144),
+                    PlaceObject(Vec3f(-0.6f, 0, 1.5f), -0.5f, 0.2f));
+}
+
+// A torus drawn over by a slightly thicker one on the same ring, with its
+// checkers shifted half a square, both moved 1.2 units towards kTorusEye so
+// that they lie between 1.2 and 2.4 units from the eye: close to the near
+// plane, where 1 / distance and so screen z changes fastest. A format that
+// cannot tell the two apart there shows the inner torus's inverted checkers.
+TGAImage RenderNearTori(DepthFormat format, StageTimes &t) {
+  Vec3f toward_eye = kTorusEye;
+  toward_eye.Normalize();
+  const Mesh inner = Torus(48, 24, 0.6f, 0.25f);
+  const Mesh outer = Torus(48, 24, 0.6f, 0.27f);
+  Mesh mesh;
+  for (const Mesh *part : {&inner, &outer}) {
+    const int first = static_cast<int>(mesh.verts.size());
+    const Vec2f shift(part == &outer ? 1.f / 32 : 0.f, 0.f);
+    for (size_t i = 0; i < part->verts.size(); i++) {
+      mesh.verts.push_back(part->verts[i] + toward_eye * 1.2f);
+      mesh.uvs.push_back(part->uvs[i] + shift);
+      mesh.norms.push_back(part->norms[i]);
+    }
+    for (const Vec3i &corner : part->corners)
+      mesh.corners.push_back(corner + Vec3i(first, first, first));
+  }
+  const Model model(mesh.verts, mesh.uvs, mesh.norms, mesh.corners,
+                    Checkerboard(256, 16));
+  return RenderForward(model, kTorusEye, format, t);
+}
+
+// The crowd behind a large head that hides much of it.
+const InstancedScene &WalledCrowd() {
+  static const InstancedScene scene = [] {
+    InstancedScene walled = Crowd();
+    walled.AddInstance(walled.model_of(1),
+                       PlaceObject(Vec3f(0, 0.3f, 1.2f), 0.f, 0.8f));
+    return walled;
+  }();
+  return scene;
+}
+
+// The walled crowd drawn in full or with occlusion queries.
+TGAImage RenderWalledCrowd(bool occlusion, StageTimes &t) {
+  const InstancedScene &scene = WalledCrowd();
+  StageTimer timer(t, "render");
+  Vec3f light_dir = kCrowdEye * -1.f;
+  light_dir.Normalize();
+  const Matrix transform = SceneTransform(kCrowdEye);
+  DepthBuffer depth(kSize, kSize);
+  TGAImage image(kSize, kSize, TGAImage::RGB);
+  if (!occlusion) {
+    DrawScene(scene, transform, light_dir, depth, image);
+    return image;
+  }
+  const SceneStats stats =
+      DrawSceneOccluded(scene, transform, light_dir, depth, image);
+  // The head hides a fifth of the visible crowd; the queries must find it.
+  if (stats.occluded < 10)
+    return Fail(t, "stats.occluded >= 10");
+  return image;
+}
+
+// The box [lo, hi] as a closed mesh whose faces wind counter-clockwise seen
+// from outside, like Obj faces.
+std::unique_ptr<Model> BoxModel(const Vec3f &lo, const Vec3f &hi) {
+  Mesh mesh;
+  for (int corner = 0; corner < 8; corner++) {
+    mesh.verts.push_back(Vec3f(corner & 1 ? hi.x : lo.x,
+                               corner & 2 ? hi.y : lo.y,
+                               corner & 4 ? hi.z : lo.z));
+  }
+  mesh.uvs.push_back(Vec2f(0, 0));
+  mesh.norms.push_back(Vec3f(0, 0, 1));
+  // Each face's corners, counter-clockwise from outside, in the order -x,
+  // +x, -y, +y, -z, +z.
+  constexpr int kFaces[6][4] = {{0, 4, 6, 2}, {1, 3, 7, 5}, {0, 1, 5, 4},
+                                {2, 6, 7, 3}, {0, 2, 3, 1}, {4, 5, 7, 6}};
+  for (const auto &q : kFaces) {
+    for (int k : {q[0], q[1], q[2], q[0], q[2], q[3]})
+      mesh.corners.push_back(Vec3i(k, 0, 0));
+  }
+  return std::make_unique<Model>(mesh.verts, mesh.uvs, mesh.norms,
+                                 mesh.corners, Checkerboard(2, 1));
+}
+
+// The walled crowd with each instance behind the wall queried through
+// QueryMesh on a quarter-size LOD of its model, in batch order, and drawn
+// only if the LOD shows. A box mesh around every instance must count
+// exactly the pixels QueryBox counts for the same box, which only holds if
+// QueryMesh keeps the same faces, those towards the camera.
+TGAImage RenderMeshQueriedCrowd(StageTimes &t) {
+  const InstancedScene &scene = WalledCrowd();
+  struct Proxies {
+    std::unique_ptr<Model> lod;
+    std::unique_ptr<Model> box;
+  };
+  static const std::vector<Proxies> proxies = [&scene] {
+    std::vector<Proxies> all;
+    for (InstancedScene::ModelId m = 0; m < scene.nmodels(); m++) {
+      const Model &model = scene.model(m);
+      all.push_back({SimplifyModel(model, model.nfaces() / 4),
+                     BoxModel(model.bbox_min(), model.bbox_max())});
+    }
+    return all;
+  }();
+  StageTimer timer(t, "render");
+  Vec3f light_dir = kCrowdEye * -1.f;
+  light_dir.Normalize();
+  const Matrix transform = SceneTransform(kCrowdEye);
+  DepthBuffer depth(kSize, kSize);
+  TGAImage image(kSize, kSize, TGAImage::RGB);
+  const InstancedScene::InstanceId wall = scene.ninstances() - 1;
+  const InstanceBatch walls{scene.model_of(wall), {wall}};
+  DrawBatches(scene, std::span<const InstanceBatch>(&walls, 1), transform,
+              light_dir, depth, image);
+  size_t occluded = 0;
+  for (const InstanceBatch &batch :
+       BatchInstances(scene, transform, kSize, kSize)) {
+    const Model &model = scene.model(batch.model);
+    const Proxies &proxy = proxies[batch.model];
+    for (InstancedScene::InstanceId id : batch.instances) {
+      if (id == wall)
+        continue;
+      const Matrix instance_transform = transform * scene.world(id);
+      if (QueryMesh(*proxy.box, instance_transform, depth) !=
+          QueryBox(model.bbox_min(), model.bbox_max(), instance_transform,
+                   depth))
+        return Fail(t, "QueryMesh on a box mesh == QueryBox");
+      if (QueryMesh(*proxy.lod, instance_transform, depth, 1) == 0) {
+        occluded++;
+        continue;
+      }
+      const InstanceBatch one{batch.model, {id}};
+      DrawBatches(scene, std::span<const InstanceBatch>(&one, 1), transform,
+                  light_dir, depth, image);
+    }
+  }
+  if (occluded < 10)
+    return Fail(t, "occluded >= 10");
+  return image;
+}
+
+TGAImage RenderCrowd(bool cull, StageTimes &t) {
+  static const InstancedScene scene = Crowd();
+  StageTimer timer(t, "render");
+  Vec3f light_dir = kCrowdEye * -1.f;
+  light_dir.Normalize();
+  const Matrix transform = SceneTransform(kCrowdEye);
+  DepthBuffer depth(kSize, kSize);
+  TGAImage image(kSize, kSize, TGAImage::RGB);
+  if (cull) {
+    const SceneStats stats =
+        DrawScene(scene, transform, light_dir, depth, image);
+    // Culling must have something to do here for the scene to test it.
+    if (stats.frustum_culled == 0)
+      return Fail(t, "frustum_culled > 0");
+    if (stats.batches != 2)
+      return Fail(t, "batches == 2");
+  } else {
+    std::vector<InstanceBatch> batches(scene.nmodels());
+    for (InstancedScene::InstanceId i = 0; i < scene.ninstances(); i++) {
+      batches[scene.model_of(i)].model = scene.model_of(i);
+      batches[scene.model_of(i)].instances.push_back(i);
+    }
+    DrawBatches(scene, batches, transform, light_dir, depth, image);
+  }
+  return image;
+}
+
+std::vector<Scene> Scenes() {
+  return {
+      {"head_forward", "head_forward", 0, 0.0,
+       [](StageTimes &t) {
+         return RenderForward(*Head(), kFront, DepthFormat::kFloat32, t);
+       }},
+      {"head_piped", "head_forward", 0, 0.0,
+       [](StageTimes &t) {
+         int fds[2];
+         if (pipe(fds) != 0)
+           return Fail(t, "pipe()");
+         TGAImage received(kSize, kSize, TGAImage::RGB);
+         std::thread reader([&] {
+           ReadAll(fds[0], received.data(), kSize * kSize * TGAImage::RGB);
+         });
+         FramebufferPool pool;
+         RawFdSink sink(fds[1]);
+         {
+           TaskScheduler scheduler(2);
+           AsyncFrameWriter writer(pool, sink, scheduler);
+           writer.Submit(
+               RenderForward(*Head(), kFront, DepthFormat::kFloat32, t));
+           StageTimer timer(t, "stream");
+           writer.Finish();
+           // Closing the write end lets a short read end instead of block.
+           close(fds[1]);
+           reader.join();
+         }
+         close(fds[0]);
+         // The writer declares its frames bottom-up; the pool must not hand
+         // that on to the next user.
+         if (pool.Acquire(kSize, kSize, TGAImage::RGB).row_order() !=
+             TGAImage::RowOrder::kTopDown)
+           return Fail(t, "pooled frame is top-down");
+         // Streams carry the top row first.
+         received.FlipVertically();
+         return received;
+       }},
+      {"head_shm", "head_forward", 0, 0.0,
+       [](StageTimes &t) {
+         const std::string name =
+             "/render_tests_" + std::to_string(getpid());
+         {
+           // With no reader the one slot stays full: the second write times
+           // out and the third fails without waiting again.
+           SharedMemoryRingSink stalled(name, 4, 4, TGAImage::RGB, 1,
+                                        std::chrono::milliseconds(1));
+           const TGAImage small(4, 4, TGAImage::RGB);
+           if (!stalled.Write(small, 7))
+             return Fail(t, "first write to a free slot");
+           if (stalled.Write(small, 8) || stalled.Write(small, 9))
+             return Fail(t, "writes to a full ring fail");
+           // A second sink must not take over the live ring.
+           if (SharedMemoryRingSink(name, 4, 4, TGAImage::RGB).ok())
+             return Fail(t, "second sink on a live name fails");
+           // The slot keeps the index of the frame written into it.
+           SharedMemoryRingReader late(name);
+           int index = -1;
+           if (!late.Acquire(&index) || index != 7)
+             return Fail(t, "stalled slot index == 7");
+         }
+         FramebufferPool pool;
+         SharedMemoryRingSink sink(name, kSize, kSize, TGAImage::RGB, 2);
+         SharedMemoryRingReader reader(name);
+         TGAImage received(kSize, kSize, TGAImage::RGB);
+         // The frame is written by the worker while this thread reads it.
+         TaskScheduler scheduler(2);
+         AsyncFrameWriter writer(pool, sink, scheduler);
+         writer.Submit(
+             RenderForward(*Head(), kFront, DepthFormat::kFloat32, t));
+         StageTimer timer(t, "stream");
+         int index = -1;
+         if (const unsigned char *frame = reader.Acquire(&index)) {
+           std::copy_n(frame, kSize * kSize * TGAImage::RGB, received.data());
+           reader.Release();
+         }
+         writer.Finish();
+         if (index != 0)
+           return Fail(t, "streamed frame index == 0");
+         received.FlipVertically();
+         return received;
+       }},
+      {"head_instanced", "head_forward", 0, 0.0,
+       [](StageTimes &t) {
+         InstancedScene scene;
+         scene.AddInstance(scene.AddModel(Head()), Matrix::Identity(4));
+         StageTimer timer(t, "render");
+         Vec3f light_dir = kFront * -1.f;
+         light_dir.Normalize();
+         DepthBuffer depth(kSize, kSize);
+         TGAImage image(kSize, kSize, TGAImage::RGB);
+         DrawScene(scene, SceneTransform(kFront), light_dir, depth, image);
+         return image;
+       }},
+      {"head_compact", "head_forward", 1, 0.002,
+       [](StageTimes &t) {
+         std::unique_ptr<CompactMesh> mesh;
+         {
+           StageTimer timer(t, "build");
+           mesh = std::make_unique<CompactMesh>(*Head());
+         }
+         // Quantized positions, unorm uvs and 16-bit indices should take
+         // well under half of the float arrays they replace.
+         const Model &head = *Head();
+         const size_t full = head.verts().size_bytes() +
+                             head.uvs().size_bytes() +
+                             head.corners().size_bytes();
+         if (mesh->wide_indices())
+           return Fail(t, "16-bit indices");
+         if (mesh->bytes() * 2 > full)
+           return Fail(t, "compact mesh under half the arrays");
+         StageTimer timer(t, "render");
+         DepthBuffer depth(kSize, kSize);
+         TGAImage image(kSize, kSize, TGAImage::RGB);
+         DrawCompactMesh(*mesh, SceneTransform(kFront), Vec3f(0, 0, -1),
+                         depth, image);
+         return image;
+       }},
+      {"head_tiled", "head_forward", 0, 0.0,
+       [](StageTimes &t) {
+         static TaskScheduler scheduler(4);
+         // A smaller frame first, so the real one reuses and grows its bins.
+         TiledRenderer renderer(32);
+         DepthBuffer small_depth(kSize / 2, kSize / 2);
+         TGAImage small_image(kSize / 2, kSize / 2, TGAImage::RGB);
+         renderer.Draw(scheduler, *Head(), SceneTransform(Vec3f(0, 0, -3)),
+                       Vec3f(0, 0, 1), small_depth, small_image);
+         StageTimer timer(t, "render");
+         DepthBuffer depth(kSize, kSize);
+         TGAImage image(kSize, kSize, TGAImage::RGB);
+         renderer.Draw(scheduler, *Head(), SceneTransform(kFront),
+                       Vec3f(0, 0, -1), depth, image);
+         return image;
+       }},
+      {"head_unorm16", "head_forward", 1, 0.002,
+       [](StageTimes &t) {
+         return RenderForward(*Head(), kFront, DepthFormat::kUnorm16, t);
+       }},
+      {"head_unorm24", "head_forward", 1, 0.002,
+       [](StageTimes &t) {
+         return RenderForward(*Head(), kFront, DepthFormat::kUnorm24, t);
+       }},
+      {"head_reversed_z", "head_forward", 1, 0.002,
+       [](StageTimes &t) {
+         return RenderForward(*Head(), kFront, DepthFormat::kFloat32ReversedZ,
+                              t);
+       }},
+      {"near_tori", "near_tori", 0, 0.0,
+       [](StageTimes &t) {
+         return RenderNearTori(DepthFormat::kFloat32, t);
+       }},
+      {"near_tori_unorm16", "near_tori", 1, 0.002,
+       [](StageTimes &t) {
+         return RenderNearTori(DepthFormat::kUnorm16, t);
+       }},
+      {"near_tori_unorm24", "near_tori", 1, 0.002,
+       [](StageTimes &t) {
+         return RenderNearTori(DepthFormat::kUnorm24, t);
+       }},
+      {"near_tori_reversed_z", "near_tori", 1, 0.002,
+       [](StageTimes &t) {
+         return RenderNearTori(DepthFormat::kFloat32ReversedZ, t);
+       }},
+      {"head_orbit", "head_orbit", 2, 0.002,
+       [](StageTimes &t) {
+         const Vec3f eye(3.f * std::sin(1.f), 0.5f, 3.f * std::cos(1.f));
+         return RenderForward(*Head(), eye, DepthFormat::kFloat32, t);
+       }},
+      {"head_meshlets", "head_meshlets", 2, 0.002,
+       [](StageTimes &t) {
+         std::unique_ptr<Model> model;
+         std::vector<Meshlet> meshlets;
+         {
+           StageTimer timer(t, "build");
+           const Model &head = *Head();
+           model = std::make_unique<Model>(head.verts(), head.uvs(),
+                                           head.norms(), head.corners(),
+                                           head.shared_diffuse_map());
+           model->OptimizeVertexCache();
+           meshlets = BuildMeshlets(*model);
+         }
+         StageTimer timer(t, "render");
+         DepthBuffer depth(kSize, kSize);
+         TGAImage image(kSize, kSize, TGAImage::RGB);
+         DrawMeshlets(*model, meshlets, SceneTransform(kFront),
+                      Vec3f(0, 0, -1), depth, image);
+         return image;
+       }},
+      {"head_lod", "head_lod", 2, 0.002,
+       [](StageTimes &t) {
+         std::unique_ptr<Model> lod;
+         {
+           StageTimer timer(t, "simplify");
+           lod = SimplifyModel(*Head(), Head()->nfaces() / 4);
+         }
+         return RenderForward(*lod, kFront, DepthFormat::kFloat32, t);
+       }},
+      {"torus_seam_lod", "torus_seam_lod", 0, 0.0,
+       [](StageTimes &t) {
+         const Mesh mesh = SeamTorus(48, 24, 0.6f, 0.25f);
+         const Model model(mesh.verts, mesh.uvs, mesh.norms, mesh.corners,
+                           Checkerboard(256, 16));
+         std::unique_ptr<Model> lod;
+         {
+           StageTimer timer(t, "simplify");
+           lod = SimplifyModel(model, model.nfaces() / 4);
+         }
+         if (lod->nfaces() * 2 > model.nfaces())
+           return Fail(t, "lod under half the faces");
+         if (!SeamUvsKept(model, *lod))
+           return Fail(t, "SeamUvsKept");
+         return RenderForward(*lod, kTorusEye, DepthFormat::kFloat32, t);
+       }},
+      {"head_progressive", "head_forward", 0, 0.0,
+       [](StageTimes &t) {
+         static const std::unique_ptr<Model> preview =
+             SimplifyModel(*Head(), Head()->nfaces() / 8);
+         StageTimer timer(t, "render");
+         Vec3f light_dir = kFront * -1.f;
+         light_dir.Normalize();
+         DepthBuffer depth(kSize, kSize);
+         TGAImage image(kSize, kSize, TGAImage::RGB);
+         const ProgressiveStats stats = RenderProgressive(
+             *Head(), *preview, SceneTransform(kFront), light_dir,
+             std::chrono::steady_clock::time_point::max(), depth, image);
+         if (!stats.complete)
+           return Fail(t, "stats.complete");
+         return image;
+       }},
+      {"head_preview", "head_preview", 0, 0.0,
+       [](StageTimes &t) {
+         static const std::unique_ptr<Model> preview =
+             SimplifyModel(*Head(), Head()->nfaces() / 8);
+         StageTimer timer(t, "render");
+         Vec3f light_dir = kFront * -1.f;
+         light_dir.Normalize();
+         DepthBuffer depth(kSize, kSize);
+         TGAImage image(kSize, kSize, TGAImage::RGB);
+         // A deadline already passed leaves only the preview.
+         const ProgressiveStats stats = RenderProgressive(
+             *Head(), *preview, SceneTransform(kFront), light_dir,
+             std::chrono::steady_clock::now(), depth, image);
+         if (stats.complete || stats.tiles_refined != 0)
+           return Fail(t, "passed deadline refines nothing");
+         return image;
+       }},
+      {"head_msaa4", "head_msaa4", 2, 0.002,
+       [](StageTimes &t) {
+         StageTimer timer(t, "render");
+         const Model &model = *Head();
+         const Matrix transform = SceneTransform(kFront);
+         MsaaTarget target(kSize, kSize, 4);
+         for (size_t i = 0; i < model.nfaces(); i++) {
+           const std::array<size_t, 3> face = model.face(i);
+           Vec3f world_coords[3];
+           Vec2i uv[3];
+           for (int j = 0; j < 3; j++) {
+             world_coords[j] = model.vert(face[j]);
+             uv[j] = model.uv(i, j);
+           }
+           DrawFaceMsaa(transform, Vec3f(0, 0, -1), world_coords, uv,
+                        model.diffuse_map(), target);
+         }
+         TGAImage image(kSize, kSize, TGAImage::RGB);
+         target.Resolve(image);
+         return image;
+       }},
+      {"head_deferred", "head_deferred", 2, 0.002,
+       [](StageTimes &t) {
+         GBuffer gbuffer(kSize, kSize);
+         {
+           StageTimer timer(t, "geometry");
+           gbuffer.Draw(*Head(), SceneTransform(kFront));
+         }
+         StageTimer timer(t, "lighting");
+         Vec3f key(1, -1, -1);
+         key.Normalize();
+         const Light lights[] = {{key, 0.8f}, {Vec3f(0, 0, -1), 0.4f}};
+         TGAImage image(kSize, kSize, TGAImage::RGB);
+         gbuffer.Shade(lights, image);
+         return image;
+       }},
+      {"head_depth", "head_depth", 0, 0.0,
+       [](StageTimes &t) {
+         DepthBuffer depth(kSize, kSize);
+         TGAImage image(kSize, kSize, TGAImage::RGB);
+         {
+           StageTimer timer(t, "render");
+           DrawFaces(*Head(), SceneTransform(kFront), Vec3f(0, 0, -1), depth,
+                     image);
+         }
+         StageTimer timer(t, "postprocess");
+         TGAImage gray;
+         DepthToGray(depth, 0.f, kDepth, gray);
+         return gray;
+       }},
+      {"head_resized", "head_resized", 1, 0.0,
+       [](StageTimes &t) {
+         const TGAImage image =
+             RenderForward(*Head(), kFront, DepthFormat::kFloat32, t);
+         StageTimer timer(t, "postprocess");
+         TGAImage half, resized, gray, rgb;
+         DownscaleBox(image, 2, half);
+         ResizeBilinear(half, kSize / 3, kSize / 3, resized);
+         ConvertFormat(resized, TGAImage::GRAYSCALE, gray);
+         ConvertFormat(gray, TGAImage::RGB, rgb);
+         rgb.FlipHorizontally();
+         return rgb;
+       }},
+      {"torus_arrays", "torus_arrays", 2, 0.002,
+       [](StageTimes &t) {
+         const Mesh mesh = Torus(48, 24, 0.6f, 0.25f);
+         const Model model(mesh.verts, mesh.uvs, mesh.norms, mesh.corners,
+                           Checkerboard(256, 16));
+         return RenderForward(model, kTorusEye, DepthFormat::kFloat32, t);
+       }},
+      {"torus_obj", "torus_arrays", 2, 0.002,
+       [](StageTimes &t) {
+         // Small chunks, so the file is split even though it is far below
+         // Model::kMinChunkBytes; every face chunk then resolves its
+         // relative indices against vertices counted in other chunks.
+         constexpr size_t kChunkBytes = 4096;
+         std::unique_ptr<Model> model;
+         {
+           StageTimer timer(t, "load");
+           model = std::make_unique<Model>(TorusObj().c_str(), 4,
+                                           ModelLoadFlags::kDefault,
+                                           kChunkBytes);
+         }
+         const Model serial(TorusObj().c_str(), 1);
+         const Model seven(TorusObj().c_str(), 7, ModelLoadFlags::kDefault,
+                           kChunkBytes);
+         if (!SameArrays(*model, serial))
+           return Fail(t, "SameArrays(4 threads, serial)");
+         if (!SameArrays(seven, serial))
+           return Fail(t, "SameArrays(7 threads, serial)");
+         return RenderForward(*model, kTorusEye, DepthFormat::kFloat32, t);
+       }},
+      {"torus_stream", "torus_arrays", 2, 0.002,
+       [](StageTimes &t) {
+         // A cached texture must keep its pixels when its file is rewritten
+         // in place, as WriteTgaFile does, while it is still held.
+         const std::string texture_path =
+             "torus_stream_" + std::to_string(getpid()) + ".tga";
+         if (!Checkerboard(256, 16)->WriteTgaFile(texture_path.c_str(), false))
+           return Fail(t, "write texture");
+         std::shared_ptr<const TGAImage> texture =
+             cache.GetTexture(texture_path);
+         const bool rewritten =
+             Checkerboard(256, 4)->WriteTgaFile(texture_path.c_str(), false);
+         std::remove(texture_path.c_str());
+         if (!texture || !rewritten)
+           return Fail(t, "load and rewrite texture");
+         StageTimer timer(t, "render");
+         ObjStreamOptions stream_options;
+         stream_options.chunk_bytes = 4096;
+         stream_options.batch_triangles = 256;
+         ObjStream stream(TorusObj().c_str(), stream_options);
+         Vec3f light_dir = kTorusEye * -1.f;
+         light_dir.Normalize();
+         const Matrix transform = SceneTransform(kTorusEye);
+         DepthBuffer depth(kSize, kSize);
+         TGAImage image(kSize, kSize, TGAImage::RGB);
+         std::vector<StreamTriangle> batch;
+         while (stream.Next(batch)) {
+           for (const StreamTriangle &triangle : batch) {
+             Vec2i uv[3];
+             for (int j = 0; j < 3; j++) {
+               uv[j] = Vec2i(triangle.uv[j].x * texture->width(),
+                             triangle.uv[j].y * texture->height());
+             }
+             DrawFace(transform, light_dir, triangle.verts, uv, *texture,
+                      depth, image);
+           }
+         }
+         return image;
+       }},
+      {"crowd_culled", "crowd_culled", 0, 0.0,
+       [](StageTimes &t) { return RenderCrowd(true, t); }},
+      {"crowd_unculled", "crowd_culled", 0, 0.0,
+       [](StageTimes &t) { return RenderCrowd(false, t); }},
+      {"crowd_edited", "crowd_edited", 0, 0.0,
+       [](StageTimes &t) {
+         InstancedScene scene = Crowd();
+         EditCrowd(scene);
+         StageTimer timer(t, "render");
+         Vec3f light_dir = kCrowdEye * -1.f;
+         light_dir.Normalize();
+         DepthBuffer depth(kSize, kSize);
+         TGAImage image(kSize, kSize, TGAImage::RGB);
+         DrawScene(scene, SceneTransform(kCrowdEye), light_dir, depth, image);
+         return image;
+       }},
+      {"crowd_incremental", "crowd_edited", 0, 0.0,
+       [](StageTimes &t) {
+         InstancedScene scene = Crowd();
+         Vec3f light_dir = kCrowdEye * -1.f;
+         light_dir.Normalize();
+         const Matrix transform = SceneTransform(kCrowdEye);
+         IncrementalRenderer renderer(kSize, kSize, 16);
+         renderer.Render(scene, transform, light_dir);
+         EditCrowd(scene);
+         StageTimer timer(t, "update");
+         const IncrementalStats stats =
+             renderer.Render(scene, transform, light_dir);
+         // The edit covers a few tiles; redrawing most of them would not
+         // test anything.
+         if (stats.instances_changed != 3 ||
+             stats.tiles_redrawn * 3 > stats.tiles)
+           return Fail(t, "edit redraws under a third of the tiles");
+         return renderer.image();
+       }},
+      {"crowd_walled", "crowd_walled", 0, 0.0,
+       [](StageTimes &t) { return RenderWalledCrowd(false, t); }},
+      {"crowd_occluded", "crowd_walled", 0, 0.0,
+       [](StageTimes &t) { return RenderWalledCrowd(true, t); }},
+      {"crowd_mesh_queried", "crowd_walled", 0, 0.0,
+       [](StageTimes &t) { return RenderMeshQueriedCrowd(t); }},
+  };
+}
+
+// Per-pixel comparison; writes the rendered and diff images when the
+// fraction of pixels differing by more than the tolerance is too high.
+bool Compare(const Scene &scene, const TGAImage &image) {
+  const std::string golden_path =
+      options->golden_dir + "/" + scene.golden + ".tga";
+  TGAImage golden;
+  if (!golden.ReadTgaFile(golden_path.c_str())) {
+    std::cerr << scene.name << ": missing golden " << golden_path << std::endl;
+    return false;
+  }
+  if (golden.width() != image.width() || golden.height() != image.height()) {
+    std::cerr << scene.name << ": golden size differs" << std::endl;
+    return false;
+  }
+  TGAImage diff(image.width(), image.height(), TGAImage::RGB);
+  size_t mismatched = 0;
+  int worst = 0;
+  for (int y = 0; y < image.height(); y++) {
+    for (int x = 0; x < image.width(); x++) {
+      const TGAColor a = image.Get(x, y);
+      const TGAColor b = golden.Get(x, y);
+      int delta = 0;
+      for (int c = 0; c < 3; c++)
+        delta = std::max(delta, std::abs(a.raw[c] - b.raw[c]));
+      worst = std::max(worst, delta);
+      if (delta > scene.tolerance) {
+        mismatched++;
+        diff.Set(x, y, TGAColor(255, 0, 0));
+      } else {
+        diff.Set(x, y, TGAColor(a.r / 4, a.g / 4, a.b / 4));
+      }
+    }
+  }
+  const double fraction =
+      static_cast<double>(mismatched) / (image.width() * image.height());
+  if (fraction <= scene.max_mismatch)
+    return true;
+  const std::string prefix = std::string(scene.name);
+  TGAImage actual = image;
+  actual.WriteTgaFile((prefix + "_actual.tga").c_str());
+  diff.WriteTgaFile((prefix + "_diff.tga").c_str());
+  std::cerr << scene.name << ": " << mismatched << " pixels (" << fraction * 100
+            << "%) differ by more than " << scene.tolerance << ", worst "
+            << worst << "; wrote " << prefix << "_actual.tga and " << prefix
+            << "_diff.tga" << std::endl;
+  return false;
+}
+
+// Lines of "scene.stage milliseconds"; '#' starts a comment.
+std::map<std::string, double> ReadThresholds(const std::string &path) {
+  std::map<std::string, double> thresholds;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    std::string key;
+    double ms;
+    std::istringstream fields(line);
+    if (fields >> key >> ms)
+      thresholds[key] = ms;
+  }
+  return thresholds;
+}
+
+bool CheckTimes(const Scene &scene, const std::map<std::string, double> &best,
+                const std::map<std::string, double> &thresholds) {
+  bool ok = true;
+  for (const auto &[stage, ms] : best) {
+    const std::string key = std::string(scene.name) + "." + stage;
+    const auto limit = thresholds.find(key);
+    std::cout << "  " << key << " " << ms << " ms";
+    if (limit != thresholds.end()) {
+      const double allowed = limit->second * options->perf_scale;
+      std::cout << " (limit " << allowed << " ms)";
+      if (ms > allowed) {
+        std::cout << " REGRESSED";
+        ok = false;
+      }
+    }
+    std::cout << std::endl;
+  }
+  return ok;
+}
+
+bool RunScene(const Scene &scene,
+              const std::map<std::string, double> &thresholds) {
+  std::map<std::string, double> best;
+  TGAImage image;
+  for (int run = 0; run < kRuns; run++) {
+    StageTimes times;
+    image = scene.render(times);
+    if (!times.failed.empty()) {
+      for (const std::string &check : times.failed)
+        std::cout << scene.name << ": check failed: " << check << std::endl;
+      return false;
+    }
+    for (const auto &[stage, ms] : times.ms)
+      best[stage] = run ? std::min(best[stage], ms) : ms;
+  }
+  image.FlipVertically();
+  if (options->update) {
+    if (std::string(scene.name) != scene.golden)
+      return true;
+    const std::string path = options->golden_dir + "/" + scene.golden + ".tga";
+    std::cout << scene.name << ": wrote " << path << std::endl;
+    return image.WriteTgaFile(path.c_str());
+  }
+  bool ok = true;
+  if (!options->timing_only) {
+    ok = Compare(scene, image);
+    std::cout << scene.name << (ok ? " matches " : " does not match ")
+              << scene.golden << std::endl;
+  }
+  ok &= CheckTimes(scene, best, thresholds);
+  return ok;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  Options parsed;
+  std::vector<std::string> names;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg = argv[i];
+    if (arg == "--update") {
+      parsed.update = true;
+    } else if (arg == "--golden-dir" && i + 1 < argc) {
+      parsed.golden_dir = argv[++i];
+    } else if (arg == "--obj-dir" && i + 1 < argc) {
+      parsed.obj_dir = argv[++i];
+    } else if (arg == "--thresholds" && i + 1 < argc) {
+      parsed.thresholds = argv[++i];
+    } else if (arg == "--perf-scale" && i + 1 < argc) {
+      parsed.perf_scale = std::atof(argv[++i]);
+    } else if (arg == "--timing-only") {
+      parsed.timing_only = true;
+    } else {
+      names.push_back(arg);
+    }
+  }
+  options = &parsed;
+
+  const std::map<std::string, double> thresholds =
+      ReadThresholds(parsed.thresholds);
+  const std::vector<Scene> scenes = Scenes();
+  int failed = 0;
+  int ran = 0;
+  for (const Scene &scene : scenes) {
+    if (!names.empty() &&
+        std::find(names.begin(), names.end(), scene.name) == names.end())
+      continue;
+    ran++;
+    failed += !RunScene(scene, thresholds);
+  }
+  if (ran < static_cast<int>(names.size())) {
+    std::cerr << "unknown scene name" << std::endl;
+    return 1;
+  }
+  std::cout << ran - failed << " of " << ran << " scenes passed" << std::endl;
+  return failed ? 1 : 0;
+}
@@ -1,54 +1,123 @@
+#include <fcntl.h>
 #include <math.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <new>
 
 #include "tga_image.h"
+#include "image_ops.h"
+#include "profiler.h"
+
+namespace {
+unsigned char *AllocatePixels(unsigned long nbytes) {
+  return static_cast<unsigned char *>(::operator new[](
+      nbytes, std::align_val_t(TGAImage::kPixelAlignment)));
+}
+
+void FreePixels(unsigned char *data) {
+  ::operator delete[](data, std::align_val_t(TGAImage::kPixelAlignment));
+}
+
+// Bit 5 of the image descriptor is set when the first stored row is the top.
+constexpr char kTopOrigin = 0x20;
+constexpr char kRightOrigin = 0x10;
+} // namespace
 
 TGAImage::TGAImage()
-    : data_(NULL), width_(0), height_(0), bytes_per_pixel_(0) {}
+    : data_(NULL), width_(0), height_(0), bytes_per_pixel_(0),
+      row_order_(RowOrder::kTopDown), mapping_(NULL), mapping_bytes_(0) {}
 
-TGAImage::TGAImage(int w, int h, int bpp)
-    : data_(NULL), width_(w), height_(h), bytes_per_pixel_(bpp) {
+TGAImage::TGAImage(int w, int h, int bpp, RowOrder order)
+    : data_(NULL), width_(w), height_(h), bytes_per_pixel_(bpp),
+      row_order_(order), mapping_(NULL), mapping_bytes_(0) {
   unsigned long nbytes = width_ * height_ * bytes_per_pixel_;
-  data_ = new unsigned char[nbytes];
+  data_ = AllocatePixels(nbytes);
   memset(data_, 0, nbytes);
 }
 
-TGAImage::TGAImage(const TGAImage &img) {
+TGAImage::TGAImage(const TGAImage &img) : mapping_(NULL), mapping_bytes_(0) {
   width_ = img.width_;
   height_ = img.height_;
   bytes_per_pixel_ = img.bytes_per_pixel_;
+  row_order_ = img.row_order_;
   unsigned long nbytes = width_ * height_ * bytes_per_pixel_;
-  data_ = new unsigned char[nbytes];
-  memcpy(data_, img.data_, nbytes);
+  data_ = img.data_ ? AllocatePixels(nbytes) : NULL;
+  if (data_)
+    memcpy(data_, img.data_, nbytes);
 }
 
-TGAImage::~TGAImage() {
-  if (data_)
-    delete[] data_;
+TGAImage::TGAImage(TGAImage &&img) noexcept
+    : data_(img.data_), width_(img.width_), height_(img.height_),
+      bytes_per_pixel_(img.bytes_per_pixel_), row_order_(img.row_order_),
+      mapping_(img.mapping_), mapping_bytes_(img.mapping_bytes_) {
+  img.data_ = NULL;
+  img.width_ = 0;
+  img.height_ = 0;
+  img.bytes_per_pixel_ = 0;
+  img.mapping_ = NULL;
+  img.mapping_bytes_ = 0;
+}
+
+TGAImage::~TGAImage() { Release(); }
+
+void TGAImage::Release() {
+  if (mapping_)
+    munmap(mapping_, mapping_bytes_);
+  else
+    FreePixels(data_);
+  data_ = NULL;
+  mapping_ = NULL;
+  mapping_bytes_ = 0;
 }
 
 TGAImage &TGAImage::operator=(const TGAImage &img) {
   if (this != &img) {
+    unsigned long nbytes = img.width_ * img.height_ * img.bytes_per_pixel_;
+    // Reuse the current allocation when the layout matches.
+    if (!data_ || !img.data_ || mapping_ ||
+        nbytes != (unsigned long)(width_ * height_ * bytes_per_pixel_)) {
+      Release();
+      data_ = img.data_ ? AllocatePixels(nbytes) : NULL;
+    }
+    width_ = img.width_;
+    height_ = img.height_;
+    bytes_per_pixel_ = img.bytes_per_pixel_;
+    row_order_ = img.row_order_;
     if (data_)
-      delete[] data_;
+      memcpy(data_, img.data_, nbytes);
+  }
+  return *this;
+}
+
+TGAImage &TGAImage::operator=(TGAImage &&img) noexcept {
+  if (this != &img) {
+    Release();
+    data_ = img.data_;
     width_ = img.width_;
     height_ = img.height_;
     bytes_per_pixel_ = img.bytes_per_pixel_;
-    unsigned long nbytes = width_ * height_ * bytes_per_pixel_;
-    data_ = new unsigned char[nbytes];
-    memcpy(data_, img.data_, nbytes);
+    row_order_ = img.row_order_;
+    mapping_ = img.mapping_;
+    mapping_bytes_ = img.mapping_bytes_;
+    img.data_ = NULL;
+    img.width_ = 0;
+    img.height_ = 0;
+    img.bytes_per_pixel_ = 0;
+    img.mapping_ = NULL;
+    img.mapping_bytes_ = 0;
   }
   return *this;
 }
 
 bool TGAImage::ReadTgaFile(const char *filename) {
-  if (data_)
-    delete[] data_;
-  data_ = NULL;
+  Release();
   std::ifstream in;
   in.open(filename, std::ios::binary);
   if (!in.is_open()) {
@@ -74,7 +143,8 @@ bool TGAImage::ReadTgaFile(const char *filename) {
     return false;
   }
   unsigned long nbytes = bytes_per_pixel_ * width_ * height_;
-  data_ = new unsigned char[nbytes];
+  data_ = AllocatePixels(nbytes);
+  in.ignore((unsigned char)header.id_length);
   if (3 == header.datatype_code || 2 == header.datatype_code) {
     in.read((char *)data_, nbytes);
     if (!in.good()) {
@@ -93,10 +163,9 @@ bool TGAImage::ReadTgaFile(const char *filename) {
     std::cerr << "unknown file format " << (int)header.datatype_code << "\n";
     return false;
   }
-  if (!(header.image_descriptor & 0x20)) {
-    FlipVertically();
-  }
-  if (header.image_descriptor & 0x10) {
+  row_order_ = header.image_descriptor & kTopOrigin ? RowOrder::kTopDown
+                                                    : RowOrder::kBottomUp;
+  if (header.image_descriptor & kRightOrigin) {
     FlipHorizontally();
   }
   std::cerr << width_ << "x" << height_ << "/" << bytes_per_pixel_ * 8 << "\n";
@@ -104,6 +173,48 @@ bool TGAImage::ReadTgaFile(const char *filename) {
   return true;
 }
 
+bool TGAImage::MapTgaFile(const char *filename) {
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return ReadTgaFile(filename);
+  struct stat st;
+  void *mapping = MAP_FAILED;
+  size_t file_bytes = 0;
+  if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(TGAHeader)) {
+    file_bytes = st.st_size;
+    mapping =
+        mmap(NULL, file_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (mapping == MAP_FAILED)
+    return ReadTgaFile(filename);
+  TGAHeader header;
+  memcpy(&header, mapping, sizeof(header));
+  const int bpp = header.bits_per_pixel >> 3;
+  const size_t offset = sizeof(header) + (unsigned char)header.id_length;
+  const size_t nbytes = (size_t)bpp * header.width * header.height;
+  // Only raw, left-to-right pixels can be used as they are stored.
+  if ((header.datatype_code != 2 && header.datatype_code != 3) ||
+      header.colormap_type != 0 || (header.image_descriptor & kRightOrigin) ||
+      header.width <= 0 || header.height <= 0 ||
+      (bpp != GRAYSCALE && bpp != RGB && bpp != RGBA) ||
+      offset + nbytes > file_bytes) {
+    munmap(mapping, file_bytes);
+    return ReadTgaFile(filename);
+  }
+  Release();
+  mapping_ = mapping;
+  mapping_bytes_ = file_bytes;
+  data_ = static_cast<unsigned char *>(mapping) + offset;
+  width_ = header.width;
+  height_ = header.height;
+  bytes_per_pixel_ = bpp;
+  row_order_ = header.image_descriptor & kTopOrigin ? RowOrder::kTopDown
+                                                    : RowOrder::kBottomUp;
+  std::cerr << width_ << "x" << height_ << "/" << bytes_per_pixel_ * 8 << "\n";
+  return true;
+}
+
 bool TGAImage::LoadRleData(std::ifstream &in) {
   unsigned long pixel_count = width_ * height_;
   unsigned long current_pixel = 0;
@@ -153,7 +264,8 @@ bool TGAImage::LoadRleData(std::ifstream &in) {
   return true;
 }
 
-bool TGAImage::WriteTgaFile(const char *filename, bool rle) {
+bool TGAImage::WriteTgaFile(const char *filename, bool rle) const {
+  PROFILE_SCOPE(kWrite);
   unsigned char developer_area_ref[4] = {0, 0, 0, 0};
   unsigned char extension_area_ref[4] = {0, 0, 0, 0};
   unsigned char footer[18] = {'T', 'R', 'U', 'E', 'V', 'I', 'S', 'I', 'O',
@@ -172,7 +284,8 @@ bool TGAImage::WriteTgaFile(const char *filename, bool rle) {
   header.height = height_;
   header.datatype_code =
       (bytes_per_pixel_ == GRAYSCALE ? (rle ? 11 : 3) : (rle ? 10 : 2));
-  header.image_descriptor = 0x20; // top-left origin
+  header.image_descriptor =
+      row_order_ == RowOrder::kTopDown ? kTopOrigin : 0;
   out.write((char *)&header, sizeof(header));
   if (!out.good()) {
     out.close();
@@ -217,7 +330,7 @@ bool TGAImage::WriteTgaFile(const char *filename, bool rle) {
 
 // TODO: it is not necessary to break a raw chunk for two equal pixels (for the
 // matter of the resulting size)
-bool TGAImage::UnloadRleData(std::ofstream &out) {
+bool TGAImage::UnloadRleData(std::ofstream &out) const {
   const unsigned char max_chunk_length = 128;
   unsigned long npixels = width_ * height_;
   unsigned long curpix = 0;
@@ -279,35 +392,24 @@ bool TGAImage::Set(int x, int y, const TGAColor &c) {
 bool TGAImage::FlipHorizontally() {
   if (!data_)
     return false;
-  int half = width_ >> 1;
-  for (int i = 0; i < half; i++) {
-    for (int j = 0; j < height_; j++) {
-      TGAColor c1 = Get(i, j);
-      TGAColor c2 = Get(width_ - 1 - i, j);
-      Set(i, j, c2);
-      Set(width_ - 1 - i, j, c1);
-    }
-  }
+  FlipPixelsHorizontally(data_, width_, height_, bytes_per_pixel_);
   return true;
 }
 
 bool TGAImage::FlipVertically() {
   if (!data_)
     return false;
-  unsigned long bytes_per_line = width_ * bytes_per_pixel_;
-  unsigned char *line = new unsigned char[bytes_per_line];
-  int half = height_ >> 1;
-  for (int j = 0; j < half; j++) {
-    unsigned long l1 = j * bytes_per_line;
-    unsigned long l2 = (height_ - 1 - j) * bytes_per_line;
-    memmove((void *)line, (void *)(data_ + l1), bytes_per_line);
-    memmove((void *)(data_ + l1), (void *)(data_ + l2), bytes_per_line);
-    memmove((void *)(data_ + l2), (void *)line, bytes_per_line);
-  }
-  delete[] line;
+  FlipPixelsVertically(data_, width_, height_, bytes_per_pixel_);
   return true;
 }
 
+bool TGAImage::SetRowOrder(RowOrder order) {
+  if (order == row_order_)
+    return true;
+  row_order_ = order;
+  return FlipVertically();
+}
+
 void TGAImage::Clear() {
   memset((void *)data_, 0, width_ * height_ * bytes_per_pixel_);
 }
@@ -315,7 +417,7 @@ void TGAImage::Clear() {
 bool TGAImage::Scale(int w, int h) {
   if (w <= 0 || h <= 0 || !data_)
     return false;
-  unsigned char *tdata = new unsigned char[w * h * bytes_per_pixel_];
+  unsigned char *tdata = AllocatePixels(w * h * bytes_per_pixel_);
   int nscanline = 0;
   int oscanline = 0;
   int erry = 0;
@@ -344,7 +446,7 @@ bool TGAImage::Scale(int w, int h) {
       nscanline += nlinebytes;
     }
   }
-  delete[] data_;
+  Release();
   data_ = tdata;
   width_ = w;
   height_ = h;
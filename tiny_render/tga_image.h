@@ -1,6 +1,7 @@
 #ifndef GRAPHICS_TINY_READER_TGA_IMAGE_H_
 #define GRAPHICS_TINY_READER_TGA_IMAGE_H_
 
+#include <cstddef>
 #include <fstream>
 
 #pragma pack(push, 1)
@@ -56,35 +57,65 @@ struct TGAColor {
   }
 };
 
+// Pixel storage is aligned to kPixelAlignment bytes so rows can be processed
+// with aligned vector loads, except for images mapped by MapTgaFile, which
+// use the file's bytes in place.
+//
+// Get, Set and data() address rows in storage order; row_order() says whether
+// storage row 0 is the top or the bottom of the picture. Reading keeps the
+// file's order and writing records the image's, so neither moves pixels.
 class TGAImage {
+public:
+  enum Format { GRAYSCALE = 1, RGB = 3, RGBA = 4 };
+  enum class RowOrder { kTopDown, kBottomUp };
+  static constexpr size_t kPixelAlignment = 64;
+
 protected:
   unsigned char *data_;
   int width_;
   int height_;
   int bytes_per_pixel_;
+  RowOrder row_order_;
+  // The mapping data_ points into, or null if data_ is owned.
+  void *mapping_;
+  size_t mapping_bytes_;
 
   bool LoadRleData(std::ifstream &in);
-  bool UnloadRleData(std::ofstream &out);
+  bool UnloadRleData(std::ofstream &out) const;
+  void Release();
 
 public:
-  enum Format { GRAYSCALE = 1, RGB = 3, RGBA = 4 };
-
   TGAImage();
-  TGAImage(int w, int h, int bpp);
+  TGAImage(int w, int h, int bpp, RowOrder order = RowOrder::kTopDown);
   TGAImage(const TGAImage &img);
+  TGAImage(TGAImage &&img) noexcept;
   bool ReadTgaFile(const char *filename);
-  bool WriteTgaFile(const char *filename, bool rle = true);
+  // Like ReadTgaFile, but an uncompressed file is mapped and its pixels used
+  // in place; writes go to private copies of the touched pages. The file
+  // must not be truncated or rewritten while the image lives (replacing it
+  // by rename is fine), so it suits callers that own the file for the
+  // image's lifetime, not caches. Compressed files are decoded as by
+  // ReadTgaFile.
+  bool MapTgaFile(const char *filename);
+  bool WriteTgaFile(const char *filename, bool rle = true) const;
   bool FlipHorizontally();
   bool FlipVertically();
+  // Reorders the rows into order; a no-op if they are stored that way.
+  bool SetRowOrder(RowOrder order);
+  // Records that the rows were filled in order, without moving them.
+  void DeclareRowOrder(RowOrder order) { row_order_ = order; }
   bool Scale(int w, int h);
   TGAColor Get(int x, int y) const;
   bool Set(int x, int y, const TGAColor &c);
   ~TGAImage();
   TGAImage &operator=(const TGAImage &img);
+  TGAImage &operator=(TGAImage &&img) noexcept;
   int width() const { return width_; }
   int height() const { return height_; }
   int bytes_per_pixel() const { return bytes_per_pixel_; }
+  RowOrder row_order() const { return row_order_; }
   unsigned char *data() { return data_; }
+  const unsigned char *data() const { return data_; }
   void Clear();
 };
 
@@ -0,0 +1,100 @@
+#include "tiled_renderer.h"
+
+#include <algorithm>
+
+#include "profiler.h"
+
+namespace {
+// Faces per geometry task.
+constexpr size_t kFacesPerChunk = 1024;
+} // namespace
+
+TiledRenderer::TiledRenderer(int tile_size)
+    : tile_size_(tile_size), grid_(0, 0, tile_size) {}
+
+void TiledRenderer::Draw(TaskScheduler &scheduler, const Model &model,
+                         const Matrix &transform, const Vec3f &light_dir,
+                         DepthBuffer &depth, TGAImage &image) {
+  scheduler_ = &scheduler;
+  model_ = &model;
+  transform_ = &transform;
+  light_dir_ = light_dir;
+  depth_ = &depth;
+  image_ = &image;
+  grid_ = TileGrid(image.width(), image.height(), tile_size_);
+  const size_t ntiles = grid_.ntiles();
+  nchunks_ = (model.nfaces() + kFacesPerChunk - 1) / kFacesPerChunk;
+  while (chunks_.size() < nchunks_)
+    chunks_.emplace_back();
+  while (tiles_.size() < ntiles)
+    tiles_.emplace_back();
+  for (size_t c = 0; c < nchunks_; c++)
+    chunks_[c].binned.store(false, std::memory_order_relaxed);
+  for (size_t t = 0; t < ntiles; t++) {
+    tiles_[t].drawn = 0;
+    tiles_[t].running = false;
+  }
+  for (size_t c = 0; c < nchunks_; c++)
+    scheduler.Spawn(tasks_, [this, c] { Bin(c); });
+  scheduler.Wait(tasks_);
+}
+
+void TiledRenderer::Bin(size_t c) {
+  Chunk &chunk = chunks_[c];
+  chunk.bins.Bin(*model_, c * kFacesPerChunk,
+                 std::min(model_->nfaces(), (c + 1) * kFacesPerChunk),
+                 *transform_, light_dir_, grid_);
+  chunk.binned.store(true, std::memory_order_release);
+  for (int t = 0; t < grid_.ntiles(); t++)
+    Kick(t);
+}
+
+bool TiledRenderer::NextReady(int tile) {
+  Tile &state = tiles_[tile];
+  while (state.drawn < nchunks_ &&
+         chunks_[state.drawn].binned.load(std::memory_order_acquire)) {
+    if (!chunks_[state.drawn].bins.empty(tile))
+      return true;
+    state.drawn++;
+  }
+  return false;
+}
+
+void TiledRenderer::Kick(int tile) {
+  Tile &state = tiles_[tile];
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.running || !NextReady(tile))
+      return;
+    state.running = true;
+  }
+  scheduler_->Spawn(tasks_, [this, tile] { DrawTile(tile); });
+}
+
+void TiledRenderer::DrawTile(int tile) {
+  PROFILE_SCOPE(kRaster);
+  Tile &state = tiles_[tile];
+  const TileRect clip = grid_.Clip(tile);
+  while (true) {
+    size_t c;
+    {
+      // The check and the end of the run are one step, so a chunk binned
+      // after it finds the tile idle and starts a new task.
+      std::lock_guard<std::mutex> lock(state.mutex);
+      if (!NextReady(tile)) {
+        state.running = false;
+        return;
+      }
+      c = state.drawn++;
+    }
+    chunks_[c].bins.Draw(tile, model_->diffuse_map(), clip, *depth_,
+                         *image_);
+  }
+}
+
+void DrawModel(TaskScheduler &scheduler, const Model &model,
+               const Matrix &transform, const Vec3f &light_dir,
+               DepthBuffer &depth, TGAImage &image, int tile_size) {
+  TiledRenderer(tile_size).Draw(scheduler, model, transform, light_dir, depth,
+                                image);
+}
@@ -0,0 +1,83 @@
+#ifndef GRAPHICS_TINY_READER_TILED_RENDERER_H_
+#define GRAPHICS_TINY_READER_TILED_RENDERER_H_
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+#include "depth_buffer.h"
+#include "face_bins.h"
+#include "geometry.h"
+#include "model.h"
+#include "task_scheduler.h"
+#include "tga_image.h"
+
+// Draws every face of a model like a DrawFace loop, as tasks on a scheduler:
+// chunks of faces are transformed, culled and binned into tile_size square
+// screen tiles in parallel, and as soon as a tile's next chunk is binned a
+// task draws it, so rasterizing overlaps binning and expensive tiles are
+// balanced by work stealing rather than split up front. A tile draws its
+// chunks in order, one task at a time, so faces keep model order within
+// every tile, which makes the image and depth identical to the serial loop.
+//
+// The bins and per-tile progress are kept between Draw calls, so a frame
+// the size of an earlier one reuses their storage instead of rebuilding it.
+class TiledRenderer {
+public:
+  explicit TiledRenderer(int tile_size = 64);
+  TiledRenderer(const TiledRenderer &) = delete;
+  TiledRenderer &operator=(const TiledRenderer &) = delete;
+
+  void Draw(TaskScheduler &scheduler, const Model &model,
+            const Matrix &transform, const Vec3f &light_dir,
+            DepthBuffer &depth, TGAImage &image);
+
+private:
+  struct Chunk {
+    FaceBins bins;
+    std::atomic<bool> binned = false;
+  };
+
+  struct Tile {
+    std::mutex mutex;
+    // Chunks drawn so far, and whether a task is drawing more.
+    size_t drawn = 0;
+    bool running = false;
+  };
+
+  void Bin(size_t c);
+  // Skips the tile's binned chunks that have nothing for it and starts a
+  // task on the next binned one, unless a task is already drawing the tile.
+  void Kick(int tile);
+  // Draws the tile's binned chunks in order until it reaches one that is not
+  // binned yet.
+  void DrawTile(int tile);
+  // Moves the tile past binned chunks with nothing for it. Returns whether
+  // the next chunk is binned and has faces to draw. Its mutex is held.
+  bool NextReady(int tile);
+
+  int tile_size_;
+
+  // The frame being drawn.
+  TaskScheduler *scheduler_ = nullptr;
+  const Model *model_ = nullptr;
+  const Matrix *transform_ = nullptr;
+  Vec3f light_dir_;
+  DepthBuffer *depth_ = nullptr;
+  TGAImage *image_ = nullptr;
+  TileGrid grid_;
+  size_t nchunks_ = 0;
+  TaskGroup tasks_;
+
+  // Deques so entries, which hold atomics and mutexes, never move; only the
+  // first nchunks_ and grid_.ntiles() are in use.
+  std::deque<Chunk> chunks_;
+  std::deque<Tile> tiles_;
+};
+
+// Draws one frame with a TiledRenderer of its own.
+void DrawModel(TaskScheduler &scheduler, const Model &model,
+               const Matrix &transform, const Vec3f &light_dir,
+               DepthBuffer &depth, TGAImage &image, int tile_size = 64);
+
+#endif // GRAPHICS_TINY_READER_TILED_RENDERER_H_